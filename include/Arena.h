@@ -0,0 +1,133 @@
+/*
+ -------------------------------------------------------------------------------
+ Arena.h
+ Robot Library Project
+
+ CLASS NAME:
+ Arena<T>
+
+ DESCRIPTION:
+ Owner of objects of one type that are created one after the other and
+ released all together. Objects are copy-constructed into large blocks of
+ aligned memory, so consecutive objects are contiguous and stay at the same
+ address for the lifetime of the arena.
+
+ A Robot keeps its joints and linkages in arenas: they are added in
+ traversal order (parents first, joints in chain order), and the kinematic
+ loops walk them in that same order.
+
+ FILES:
+ Arena.h
+
+ DEPENDENCIES:
+ Eigen
+
+ CONSTRUCTORS:
+ Arena(size_t firstBlock=16);
+
+ METHODS:
+ T* create(const T& prototype);
+ Copy prototype into the arena and return the new object.
+
+ void clear();
+ Destroy every object, newest first, and release the memory.
+
+ NOTES:
+ Objects cannot be released one at a time. The arena can not be copied.
+
+ -------------------------------------------------------------------------------
+ */
+
+
+
+#ifndef _Arena_h_
+#define _Arena_h_
+
+
+
+//------------------------------------------------------------------------------
+// Includes
+//------------------------------------------------------------------------------
+#include <vector>
+#include <new>
+#include <eigen3/Eigen/Core>
+
+
+namespace RobotKin {
+
+    template<class T>
+    class Arena
+    {
+    public:
+        //--------------------------------------------------------------------------
+        // Arena Lifecycle
+        //--------------------------------------------------------------------------
+        Arena(size_t firstBlock=16) : firstBlock_(firstBlock > 0 ? firstBlock : 1), size_(0) { }
+
+        ~Arena() { clear(); }
+
+        //--------------------------------------------------------------------------
+        // Arena Public Member Functions
+        //--------------------------------------------------------------------------
+        T* create(const T& prototype)
+        {
+            if(blocks_.empty() || used_.back() == capacity_.back())
+                grow();
+
+            T* object = new (blocks_.back() + used_.back()) T(prototype);
+            used_.back()++;
+            size_++;
+            return object;
+        }
+
+        size_t size() const { return size_; }
+
+        void clear()
+        {
+            Eigen::aligned_allocator<T> allocator;
+            for(size_t b=blocks_.size(); b-- > 0; )
+            {
+                for(size_t i=used_[b]; i-- > 0; )
+                    blocks_[b][i].~T();
+                allocator.deallocate(blocks_[b], capacity_[b]);
+            }
+
+            blocks_.resize(0);
+            used_.resize(0);
+            capacity_.resize(0);
+            size_ = 0;
+        }
+
+    protected:
+        //--------------------------------------------------------------------------
+        // Arena Protected Member Functions
+        //--------------------------------------------------------------------------
+        // Each block is twice as large as the previous one
+        void grow()
+        {
+            size_t capacity = capacity_.empty() ? firstBlock_ : 2*capacity_.back();
+            blocks_.push_back(Eigen::aligned_allocator<T>().allocate(capacity));
+            used_.push_back(0);
+            capacity_.push_back(capacity);
+        }
+
+        //--------------------------------------------------------------------------
+        // Arena Protected Member Variables
+        //--------------------------------------------------------------------------
+        std::vector<T*> blocks_;
+        std::vector<size_t> used_;
+        std::vector<size_t> capacity_;
+        size_t firstBlock_;
+        size_t size_;
+
+    private:
+        Arena(const Arena&);
+        Arena& operator=(const Arena&);
+
+    }; // class Arena
+
+} // namespace RobotKin
+
+#endif
+
+
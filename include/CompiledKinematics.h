@@ -0,0 +1,167 @@
+/*
+ -------------------------------------------------------------------------------
+ CompiledKinematics.h
+ Robot Library Project
+
+ CLASS NAME:
+ CompiledKinematics
+
+ DESCRIPTION:
+ Flattened snapshot of the kinematic tree of a Robot. Every linkage base,
+ joint and tool becomes one frame, and the frames are stored in contiguous
+ arrays in topological order (a parent always comes before its children).
+ Forward kinematics for the whole tree is then a single linear pass without
+ any pointer chasing or virtual calls.
+
+ FILES:
+ CompiledKinematics.h
+ CompiledKinematics.cpp
+
+ DEPENDENCIES:
+ Robot
+
+ CONSTRUCTORS:
+ CompiledKinematics();
+ CompiledKinematics(const Robot& robot);
+ CompiledKinematics(const Linkage& linkage);
+
+ PROPERTIES:
+ fixed - Transform of each frame with respect to its parent frame when the
+ joint value is zero.
+
+ parent - Index of the parent frame, or -1 for frames attached to the robot
+ base.
+
+ METHODS:
+ void compile(const Robot& robot);
+ Rebuild the snapshot. The snapshot does not follow later changes to the
+ robot model, so call this again after editing fixed transforms or axes.
+
+ void compile(const Linkage& linkage);
+ Snapshot of a single linkage: a base frame at the identity, the joints
+ (indexed by their local ID) and the tool. Frames are with respect to the
+ linkage.
+
+ void forwardKinematics(const Eigen::VectorXd& q, std::vector<TRANSFORM>& frames) const;
+ Compute every frame with respect to the robot for the full joint vector q.
+
+ void batchForwardKinematics(const JointBatch& Q, std::vector<TRANSFORM>& frames) const;
+ Batched version for many configurations at once. Q has one row per joint
+ and one column per configuration. The frames of configuration k are
+ stored at frames[k*nFrames()] through frames[(k+1)*nFrames()-1].
+
+ void batchToolPoses(const JointBatch& Q, size_t linkageIndex, std::vector<TRANSFORM>& poses) const;
+ Batched tool frame of one linkage, one pose per column of Q. Only the
+ frames between the robot base and that tool are computed.
+
+ NOTES:
+ Joint limits are stored but not imposed by forwardKinematics().
+
+ The batched versions keep each component of each frame in its own array
+ across configurations, so every step of the chain composition works on
+ whole packets of configurations. Build with RK_NATIVE_ARCH enabled to let
+ Eigen use AVX2 (4 doubles per instruction) instead of SSE2.
+
+ -------------------------------------------------------------------------------
+ */
+
+
+
+#ifndef _CompiledKinematics_h_
+#define _CompiledKinematics_h_
+
+
+
+//------------------------------------------------------------------------------
+// Includes
+//------------------------------------------------------------------------------
+#include "Frame.h"
+#include "RigidTransform.h"
+#include <vector>
+#include <eigen3/Eigen/Core>
+#include <eigen3/Eigen/Geometry>
+
+
+namespace RobotKin {
+
+    class CompiledKinematics
+    {
+    public:
+        //--------------------------------------------------------------------------
+        // CompiledKinematics Lifecycle
+        //--------------------------------------------------------------------------
+        CompiledKinematics();
+        CompiledKinematics(const Robot& robot);
+        CompiledKinematics(const Linkage& linkage);
+
+        void compile(const Robot& robot);
+        void compile(const Linkage& linkage);
+
+        //--------------------------------------------------------------------------
+        // CompiledKinematics Public Member Functions
+        //--------------------------------------------------------------------------
+        size_t nFrames() const;
+        size_t nJoints() const;
+        size_t nLinkages() const;
+
+        // Frame lookups using the robot's joint and linkage indices
+        size_t jointFrame(size_t jointIndex) const;
+        size_t toolFrame(size_t linkageIndex) const;
+        size_t linkageFrame(size_t linkageIndex) const;
+
+        int parent(size_t frame) const;
+        FrameType frameType(size_t frame) const;
+        JointType jointType(size_t frame) const;
+        JointKernel kernel(size_t frame) const;
+        int jointIndex(size_t frame) const;
+        TRANSFORM fixed(size_t frame) const;
+        const AXIS& axis(size_t frame) const;
+        double min(size_t frame) const;
+        double max(size_t frame) const;
+
+        void forwardKinematics(const Eigen::VectorXd& q, std::vector<TRANSFORM>& frames) const;
+
+        // Batched forward kinematics, one column of Q per configuration
+        void batchForwardKinematics(const JointBatch& Q, std::vector<TRANSFORM>& frames) const;
+        void batchToolPoses(const JointBatch& Q, size_t linkageIndex, std::vector<TRANSFORM>& poses) const;
+
+    protected:
+        //--------------------------------------------------------------------------
+        // CompiledKinematics Protected Member Variables
+        //--------------------------------------------------------------------------
+        // One entry per frame, in topological order
+        std::vector<RigidTransform> fixed_;
+        std::vector<AXIS> axis_;
+        std::vector<JointType> jointType_;
+        std::vector<JointKernel> kernel_;
+        std::vector<FrameType> frameType_;
+        std::vector<double> min_;
+        std::vector<double> max_;
+        std::vector<int> parent_;
+        std::vector<int> jointIndex_; // Index into the joint vector, -1 for non-joint frames
+
+        // Robot indices to frame indices
+        std::vector<size_t> jointFrame_;
+        std::vector<size_t> toolFrame_;
+        std::vector<size_t> linkageFrame_;
+
+    private:
+        // Rotation (column-major, columns 0-8) and translation (columns 9-11)
+        // of one frame, one row per configuration
+        typedef Eigen::Array<double, Eigen::Dynamic, 12> FrameBatch;
+
+        void clear();
+        void batchChunk(const JointBatch& Q, int start, int count,
+                        const std::vector<bool>& needed, std::vector<FrameBatch>& batch) const;
+
+        void addFrame(const TRANSFORM& fixed, int parent, FrameType frameType,
+                      JointType jointType=ANCHOR, const AXIS& axis=AXIS::UnitZ(),
+                      int jointIndex=-1, double minValue=0, double maxValue=0);
+
+    }; // class CompiledKinematics
+
+} // namespace RobotKin
+
+#endif
+
+
@@ -7,13 +7,56 @@
 
 namespace RobotKin {
 
+    class RobotState;
+
+    // The robot being solved, as seen by the damped least squares solver and
+    // by the hooks of Constraints. Robot and RobotModel both solve through
+    // this interface, so the iteration and the hooks are written once.
+    class KinematicState
+    {
+    public:
+        virtual ~KinematicState() {}
+
+        virtual double min(size_t jointIndex) const = 0;
+        virtual double max(size_t jointIndex) const = 0;
+        virtual JointType jointType(size_t jointIndex) const = 0;
+
+        virtual double value(size_t jointIndex) const = 0;
+        virtual void values(const std::vector<size_t>& jointIndices, const Eigen::VectorXd& jointValues) = 0;
+        virtual TRANSFORM jointRespectToRobot(size_t jointIndex) const = 0;
+
+        // Jacobian of the joints at location (respect to robot)
+        virtual void jacobian(Eigen::MatrixXd& J, const std::vector<size_t>& jointIndices,
+                              const TRANSLATION& location) = 0;
+
+        virtual bool getImposeLimits() const = 0;
+        virtual void setImposeLimits(bool imposeLimits) = 0;
+        virtual bool verbose() const { return false; }
+
+        // What is being solved: exactly one of these is not NULL
+        virtual Robot* robot() { return NULL; }
+        virtual RobotState* robotState() { return NULL; }
+    };
+
+    void wrapToJointLimits(const KinematicState& state, const std::vector<size_t>& jointIndices,
+                           Eigen::VectorXd& jointValues);
+
+    rk_result_t dampedLeastSquaresIK(KinematicState& state, const std::vector<size_t>& jointIndices,
+                                     Eigen::VectorXd& jointValues, const TRANSFORM& target,
+                                     Constraints& constraints);
 
     class Constraints
     {
     public:
         Constraints();
 
+        // The solvers call the KinematicState& hooks. Their defaults hand a
+        // Robot over to the Robot& hooks, so subclasses written against the
+        // Robot& signatures keep working on Robot. Override the
+        // KinematicState& hooks to also reach RobotModel solvers.
         bool performNullSpaceTask;
+        virtual Eigen::VectorXd nullSpaceTask(KinematicState& state, const Eigen::MatrixXd& J, const std::vector<size_t>& indices,
+                                              const Eigen::VectorXd& values);
         virtual Eigen::VectorXd nullSpaceTask(Robot& robot, const Eigen::MatrixXd& J, const std::vector<size_t>& indices,
                                               const Eigen::VectorXd& values);
         virtual bool nullComplete();
@@ -29,6 +72,7 @@ namespace RobotKin {
         double deltaClamp;
 
         bool customErrorClamp;
+        virtual void errorClamp(KinematicState& state, const std::vector<size_t>& indices, SCREW& error);
         virtual void errorClamp(Robot& robot, const std::vector<size_t>& indices, SCREW& error);
 
         int maxIterations;
@@ -38,7 +82,9 @@ namespace RobotKin {
         TRANSFORM finalTransform;
 
         bool useIterativeJacobianSeed;
-        virtual void iterativeJacobianSeed(Robot &robot, size_t attemptNumber,
+        virtual void iterativeJacobianSeed(KinematicState& state, size_t attemptNumber,
+                                           const std::vector<size_t>& indices, Eigen::VectorXd& values);
+        virtual void iterativeJacobianSeed(Robot& robot, size_t attemptNumber,
                                            const std::vector<size_t>& indices, Eigen::VectorXd& values);
         size_t maxAttempts;
 
@@ -46,8 +92,9 @@ namespace RobotKin {
         bool wrapSolutionToJointLimits;
 
 
-        // Allow the user to call some default constraints
-        static Constraints& Defaults();
+        // Allow the user to call some default constraints. Each call gives
+        // a separate copy, so solvers cannot change the defaults of others.
+        static Constraints Defaults();
 
     protected:
 
@@ -55,6 +102,9 @@ namespace RobotKin {
         bool hasRestingValues;
         bool nullComplete_;
 
+        Eigen::VectorXd defaultNullSpaceTask(const Eigen::VectorXd& values);
+        void defaultIterativeJacobianSeed(KinematicState& state, size_t attemptNumber,
+                                          const std::vector<size_t>& indices, Eigen::VectorXd& values);
 
     private:
 
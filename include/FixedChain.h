@@ -0,0 +1,414 @@
+/*
+ -------------------------------------------------------------------------------
+ FixedChain.h
+ Robot Library Project
+
+ CLASS NAME:
+ FixedChain<N>
+
+ DESCRIPTION:
+ Serial chain extracted from a Linkage whose number of joints is known at
+ compile time. Forward kinematics, the Jacobian and the damped least
+ squares step all work on Eigen fixed-size types (Matrix<double,6,N>,
+ Matrix<double,N,1>), so they are fully unrolled and never touch the heap.
+
+ FixedChain<Eigen::Dynamic> is the same code on dynamic types and accepts
+ linkages of any size.
+
+ FILES:
+ FixedChain.h
+
+ DEPENDENCIES:
+ Linkage
+ Constraints
+
+ CONSTRUCTORS:
+ FixedChain();
+ FixedChain(const Linkage& linkage);
+
+ METHODS:
+ bool extract(const Linkage& linkage);
+ Copy the fixed transforms, axes and limits of the linkage. Returns false
+ if the linkage does not have N joints, and leaves the chain invalid.
+
+ bool valid() const;
+ Whether the chain holds a linkage. Until it does, forwardKinematics()
+ and jacobian() give the identity and a zero Jacobian, and
+ dampedLeastSquaresIK() returns RK_SOLVER_NOT_READY.
+
+ void forwardKinematics(const Values& q, TRANSFORM& tool) const;
+ Tool frame with respect to the linkage.
+
+ void jacobian(const Values& q, Jacobian& J, TRANSFORM& tool) const;
+ Jacobian at the tool, expressed in the linkage frame, using the same
+ convention as Linkage::jacobian().
+
+ rk_result_t dampedLeastSquaresIK(Values& q, const TRANSFORM& target,
+                                  const Constraints& constraints) const;
+ Same iteration as Robot::dampedLeastSquaresIK_linkage(), with target
+ given with respect to the linkage.
+
+ NOTES:
+ The snapshot does not follow later changes to the linkage.
+
+ dampedLeastSquaresIK() uses the clamping, tolerance and joint limit
+ settings of the constraints. It does not call the virtual hooks of
+ Constraints (custom error clamp, null space task, seeding), and the tool
+ frame replaces constraints.finalTransform.
+
+ EXAMPLES:
+ Example 1: 6 DOF arm
+ ----------------------------------------------------------------------------
+ FixedChain<6> arm(hubo.const_linkage("LEFT_ARM"));
+ FixedChain<6>::Values q = FixedChain<6>::Values::Zero();
+ arm.dampedLeastSquaresIK(q, target, constraints);
+ ----------------------------------------------------------------------------
+
+ -------------------------------------------------------------------------------
+ */
+
+
+
+#ifndef _FixedChain_h_
+#define _FixedChain_h_
+
+
+
+//------------------------------------------------------------------------------
+// Includes
+//------------------------------------------------------------------------------
+#include "Frame.h"
+#include "Linkage.h"
+#include "Constraints.h"
+#include "RigidTransform.h"
+#include <eigen3/Eigen/Core>
+#include <eigen3/Eigen/Geometry>
+#include <eigen3/Eigen/Cholesky>
+
+
+namespace RobotKin {
+
+    template<int N>
+    class FixedChain
+    {
+    public:
+        //--------------------------------------------------------------------------
+        // FixedChain Types
+        //--------------------------------------------------------------------------
+        typedef Eigen::Matrix<double, N, 1> Values;
+        typedef Eigen::Matrix<double, 6, N> Jacobian;
+
+        enum { RotationCols = (N == Eigen::Dynamic) ? Eigen::Dynamic : 3*N };
+
+        //--------------------------------------------------------------------------
+        // FixedChain Lifecycle
+        //--------------------------------------------------------------------------
+        FixedChain() : tool_(RigidTransform::Identity()) { clear(); }
+
+        FixedChain(const Linkage& linkage) : tool_(RigidTransform::Identity()) { extract(linkage); }
+
+        bool extract(const Linkage& linkage)
+        {
+            if(N != Eigen::Dynamic && (size_t)N != linkage.nJoints())
+            {
+                std::cerr << "Cannot make a " << N << " joint chain from linkage "
+                          << linkage.name() << ", which has " << linkage.nJoints()
+                          << " joints" << std::endl;
+                clear();
+                return false;
+            }
+
+            int n = linkage.nJoints();
+            rotations_.resize(3, 3*n);
+            translations_.resize(3, n);
+            axes_.resize(3, n);
+            types_.resize(n);
+            kernels_.resize(n);
+            min_.resize(n);
+            max_.resize(n);
+
+            for(int i=0; i<n; i++)
+            {
+                const Joint& joint = linkage.const_joint(i);
+                rotations_.template block<3,3>(0, 3*i) = joint.respectToFixed().rotation();
+                translations_.col(i) = joint.respectToFixed().translation();
+                axes_.col(i) = joint.getJointAxis();
+                types_[i] = joint.getJointType();
+                kernels_[i] = joint.getJointKernel();
+                min_[i] = joint.min();
+                max_[i] = joint.max();
+            }
+
+            tool_ = RigidTransform(linkage.const_tool().respectToFixed());
+            valid_ = true;
+            return true;
+        }
+
+        //--------------------------------------------------------------------------
+        // FixedChain Public Member Functions
+        //--------------------------------------------------------------------------
+        bool valid() const { return valid_; }
+        int nJoints() const { return axes_.cols(); }
+        double min(int i) const { return min_[i]; }
+        double max(int i) const { return max_[i]; }
+
+        void forwardKinematics(const Values& q, TRANSFORM& tool) const
+        {
+            if(!valid_)
+            {
+                notReady();
+                tool = TRANSFORM::Identity();
+                return;
+            }
+
+            RigidTransform T(RigidTransform::Identity());
+
+            for(int i=0; i<nJoints(); i++)
+                step(i, q[i], T);
+
+            tool = (T*tool_).toIsometry();
+        }
+
+        void jacobian(const Values& q, Jacobian& J, TRANSFORM& tool) const
+        {
+            if(!valid_)
+            {
+                notReady();
+                J.setZero(6, nJoints());
+                tool = TRANSFORM::Identity();
+                return;
+            }
+
+            Eigen::Matrix<double, 3, N> z, o;
+            z.resize(3, nJoints());
+            o.resize(3, nJoints());
+            RigidTransform T(RigidTransform::Identity());
+
+            for(int i=0; i<nJoints(); i++)
+            {
+                step(i, q[i], T);
+                z.col(i) = T.linear()*axes_.col(i);
+                o.col(i) = T.translation();
+            }
+
+            tool = (T*tool_).toIsometry();
+
+            J.resize(6, nJoints());
+            for(int i=0; i<nJoints(); i++)
+            {
+                if(types_[i] == REVOLUTE)
+                {
+                    J.template block<3,1>(0,i) = z.col(i).cross(tool.translation() - o.col(i));
+                    J.template block<3,1>(3,i) = z.col(i);
+                }
+                else if(types_[i] == PRISMATIC)
+                {
+                    J.template block<3,1>(0,i) = z.col(i);
+                    J.template block<3,1>(3,i).setZero();
+                }
+                else
+                    J.col(i).setZero();
+            }
+        }
+
+        // delta = J^T (J J^T + damp^2 I)^-1 err
+        static void dampedLeastSquaresStep(const Jacobian& J, const SCREW& err, double damp, Values& delta)
+        {
+            Matrix6d A = J*J.transpose();
+            A.diagonal().array() += damp*damp;
+            delta = J.transpose()*A.ldlt().solve(err);
+        }
+
+        rk_result_t dampedLeastSquaresIK(Values& q, const TRANSFORM& target,
+                                         const Constraints& constraints, bool imposeLimits=true) const
+        {
+            if(!valid_)
+            {
+                notReady();
+                return RK_SOLVER_NOT_READY;
+            }
+
+            Jacobian J;
+            Values delta;
+            J.resize(6, nJoints());
+            delta.resize(nJoints());
+            TRANSFORM pose;
+            TRANSLATION Terr, Rerr;
+            SCREW err;
+
+            forwardKinematics(q, pose);
+            poseError(pose, target, Terr, Rerr);
+
+            int iterations = 0;
+            while( (Terr.norm() > constraints.convergenceTolerance
+                    || Rerr.norm() > constraints.convergenceTolerance)
+                   && iterations < constraints.maxIterations )
+            {
+                if(constraints.performErrorClamp)
+                {
+                    clampMag(Terr, constraints.translationClamp);
+                    clampMag(Rerr, constraints.rotationClamp);
+                }
+                err << Terr, Rerr;
+
+                jacobian(q, J, pose);
+                dampedLeastSquaresStep(J, err, constraints.dampingConstant, delta);
+                q += delta;
+
+                if(constraints.wrapToJointLimits)
+                    wrapToLimits(q);
+                if(imposeLimits)
+                    clampToLimits(q);
+
+                forwardKinematics(q, pose);
+                poseError(pose, target, Terr, Rerr);
+                iterations++;
+            }
+
+            if(constraints.wrapSolutionToJointLimits)
+                wrapToLimits(q);
+            if(imposeLimits)
+                clampToLimits(q);
+
+            forwardKinematics(q, pose);
+            poseError(pose, target, Terr, Rerr);
+
+            if(Terr.norm() <= constraints.convergenceTolerance
+                    && Rerr.norm() <= constraints.convergenceTolerance)
+                return RK_SOLVED;
+
+            return RK_DIVERGED;
+        }
+
+        EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+    protected:
+        //--------------------------------------------------------------------------
+        // FixedChain Protected Member Functions
+        //--------------------------------------------------------------------------
+        // Empty the chain: zero joints for Eigen::Dynamic, N zeroed joints
+        // otherwise, and invalid either way
+        void clear()
+        {
+            int n = (N == Eigen::Dynamic) ? 0 : N;
+            rotations_.setZero(3, 3*n);
+            translations_.setZero(3, n);
+            axes_.setZero(3, n);
+            types_.setConstant(n, ANCHOR);
+            kernels_.setZero(n);
+            min_.setZero(n);
+            max_.setZero(n);
+            tool_ = RigidTransform::Identity();
+            valid_ = false;
+        }
+
+        static void notReady()
+        {
+            std::cerr << "FixedChain has not been extracted from a linkage" << std::endl;
+        }
+
+        // Move T from the parent frame of joint i to joint i
+        void step(int i, double value, RigidTransform& T) const
+        {
+            T.translation() += T.linear()*translations_.col(i);
+            T.linear() = T.linear()*rotations_.template block<3,3>(0, 3*i);
+            applyJointKernel((JointKernel)kernels_[i], axes_.col(i), value, T);
+        }
+
+        static void poseError(const TRANSFORM& pose, const TRANSFORM& target,
+                              TRANSLATION& Terr, TRANSLATION& Rerr)
+        {
+            Eigen::AngleAxisd aaerr(target.rotation()*pose.rotation().transpose());
+            if(fabs(aaerr.angle()) <= M_PI)
+                Rerr = aaerr.angle()*aaerr.axis();
+            else
+                Rerr = (aaerr.angle()-2*M_PI)*aaerr.axis();
+
+            Terr = target.translation()-pose.translation();
+        }
+
+        void wrapToLimits(Values& q) const
+        {
+            for(int i=0; i<nJoints(); i++)
+            {
+                if(types_[i] != REVOLUTE || (min_[i] <= q[i] && q[i] <= max_[i]))
+                    continue;
+
+                if( fabs(wrapToPi(q[i]-min_[i])) < fabs(wrapToPi(q[i]-max_[i])) )
+                    q[i] = min_[i];
+                else
+                    q[i] = max_[i];
+            }
+        }
+
+        void clampToLimits(Values& q) const
+        {
+            for(int i=0; i<nJoints(); i++)
+            {
+                if(q[i] < min_[i])
+                    q[i] = min_[i];
+                else if(q[i] > max_[i])
+                    q[i] = max_[i];
+            }
+        }
+
+        //--------------------------------------------------------------------------
+        // FixedChain Protected Member Variables
+        //--------------------------------------------------------------------------
+        Eigen::Matrix<double, 3, RotationCols> rotations_; // Fixed rotation of joint i in columns 3i to 3i+2
+        Eigen::Matrix<double, 3, N> translations_;
+        Eigen::Matrix<double, 3, N> axes_;
+        Eigen::Matrix<int, N, 1> types_;
+        Eigen::Matrix<int, N, 1> kernels_;
+        Values min_;
+        Values max_;
+        RigidTransform tool_;
+        bool valid_;
+
+    }; // class FixedChain
+
+
+    // Solve with a FixedChain of the right size when one is instantiated for
+    // the linkage, and with FixedChain<Eigen::Dynamic> otherwise. Target is
+    // with respect to the linkage. Building the chain on every call costs a
+    // copy of the linkage; keep a FixedChain around for repeated solves.
+    inline rk_result_t dampedLeastSquaresIK_fixedChain(const Linkage& linkage, Eigen::VectorXd& jointValues,
+                                                       const TRANSFORM& target, const Constraints& constraints,
+                                                       bool imposeLimits=true)
+    {
+        if((size_t)jointValues.size() != linkage.nJoints())
+        {
+            std::cerr << "Invalid number of joint values: " << jointValues.size()
+                      << "\n\t This should be equal to " << linkage.nJoints() << std::endl;
+            return RK_INVALID_JOINT;
+        }
+
+        rk_result_t result;
+        if(linkage.nJoints() == 6)
+        {
+            FixedChain<6> chain(linkage);
+            FixedChain<6>::Values q(jointValues);
+            result = chain.dampedLeastSquaresIK(q, target, constraints, imposeLimits);
+            jointValues = q;
+        }
+        else if(linkage.nJoints() == 7)
+        {
+            FixedChain<7> chain(linkage);
+            FixedChain<7>::Values q(jointValues);
+            result = chain.dampedLeastSquaresIK(q, target, constraints, imposeLimits);
+            jointValues = q;
+        }
+        else
+        {
+            FixedChain<Eigen::Dynamic> chain(linkage);
+            result = chain.dampedLeastSquaresIK(jointValues, target, constraints, imposeLimits);
+        }
+
+        return result;
+    }
+
+} // namespace RobotKin
+
+#endif
+
+
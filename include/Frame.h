@@ -78,6 +78,10 @@ namespace RobotKin {
 
     typedef Eigen::Matrix<double, 6, 1> SCREW;
     typedef Eigen::Matrix<double, 6, 6> Matrix6d;
+
+    // Many configurations at once: one row per joint and one column per
+    // configuration, stored joint-major so each joint's values are contiguous
+    typedef Eigen::Matrix<double, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor> JointBatch;
     
     class Robot;
     class Linkage;
@@ -166,6 +170,57 @@ namespace RobotKin {
 
     std::string JointType_to_string(JointType type);
 
+    // Joint motion specialized on the axis. Chosen once when the joint type
+    // or axis is set, so the forward kinematics loops never have to build a
+    // rotation from an arbitrary axis when the axis is a unit X, Y or Z.
+    typedef enum
+    {
+        KERNEL_FIXED = 0,
+        KERNEL_REVOLUTE_X,
+        KERNEL_REVOLUTE_Y,
+        KERNEL_REVOLUTE_Z,
+        KERNEL_REVOLUTE,
+        KERNEL_PRISMATIC_X,
+        KERNEL_PRISMATIC_Y,
+        KERNEL_PRISMATIC_Z,
+        KERNEL_PRISMATIC,
+
+        JOINT_KERNEL_SIZE
+    } JointKernel;
+
+    JointKernel selectJointKernel(JointType type, const AXIS& axis);
+
+    // Rotate columns i and j of the rotation of pose by angle about the
+    // remaining column. Works on TRANSFORM and RigidTransform.
+    template<typename Pose>
+    inline void rotateColumns(Pose& pose, int i, int j, double angle)
+    {
+        double c = cos(angle);
+        double s = sin(angle);
+        Eigen::Vector3d ci = pose.linear().col(i);
+        pose.linear().col(i) = c*ci + s*pose.linear().col(j);
+        pose.linear().col(j) = c*pose.linear().col(j) - s*ci;
+    }
+
+    // pose = pose * (motion of a joint with this kernel and axis at value).
+    // For the X/Y/Z kernels the axis is a unit axis, possibly negated.
+    template<typename Pose>
+    inline void applyJointKernel(JointKernel kernel, const AXIS& axis, double value, Pose& pose)
+    {
+        switch(kernel)
+        {
+        case KERNEL_REVOLUTE_X: rotateColumns(pose, 1, 2, value*axis[0]); break;
+        case KERNEL_REVOLUTE_Y: rotateColumns(pose, 2, 0, value*axis[1]); break;
+        case KERNEL_REVOLUTE_Z: rotateColumns(pose, 0, 1, value*axis[2]); break;
+        case KERNEL_REVOLUTE:   pose.linear() = pose.linear()*Eigen::AngleAxisd(value, axis).toRotationMatrix(); break;
+        case KERNEL_PRISMATIC_X: pose.translation() += (value*axis[0])*pose.linear().col(0); break;
+        case KERNEL_PRISMATIC_Y: pose.translation() += (value*axis[1])*pose.linear().col(1); break;
+        case KERNEL_PRISMATIC_Z: pose.translation() += (value*axis[2])*pose.linear().col(2); break;
+        case KERNEL_PRISMATIC:  pose.translation() += value*(pose.linear()*axis); break;
+        default: break;
+        }
+    }
+
 
     void clampMag(Eigen::VectorXd& v, double clamp);
     void clampMag(SCREW& v, double clamp);
@@ -184,6 +239,7 @@ namespace RobotKin {
         //--------------------------------------------------------------------------
         friend class Linkage;
         friend class Robot;
+        friend class RelativeTransforms;
         
     public:
         //--------------------------------------------------------------------------
@@ -206,7 +262,7 @@ namespace RobotKin {
         virtual const TRANSFORM& respectToFixed() const = 0;
         virtual void respectToFixed(TRANSFORM aCoordinate) = 0;
         
-        virtual TRANSFORM respectToWorld() const = 0;
+        virtual const TRANSFORM& respectToWorld() const = 0;
 
         TRANSFORM respectTo(const Frame* aFrame) const;
         TRANSFORM withRespectTo(const Frame &frame) const;
@@ -214,6 +270,10 @@ namespace RobotKin {
         virtual void printInfo() const;
         
         double gravity_constant; // TODO: Decide if there is a better place for this
+
+        // Frames hold Isometry3d members, so they need 16 byte alignment
+        // when they are created with new
+        EIGEN_MAKE_ALIGNED_OPERATOR_NEW
         
     protected:
         //--------------------------------------------------------------------------
@@ -237,6 +297,11 @@ namespace RobotKin {
 
         bool hasRobot;
         bool hasLinkage;
+
+        // Last result of respectToWorld(). Cleared whenever the linkage
+        // recomputes this frame, and by Robot::respectToWorld(TRANSFORM).
+        mutable TRANSFORM respectToWorldCache_;
+        mutable bool worldCacheValid_;
         
     }; // class Frame
     
@@ -93,6 +93,9 @@ public:
     
     // Destructor
     virtual ~Hubo();
+
+    // Copy of this Hubo, including its limits and arm and leg lengths
+    virtual Hubo* clone() const;
     
     
     //--------------------------------------------------------------------------
@@ -161,6 +164,7 @@ private:
     // Hubo Private Member Variables
     //--------------------------------------------------------------------------
     double zeroSize;
+    RobotSnapshot fkSnapshot; // Reused by armFK() and legFK() to put the joints back
     
     
 }; // class Hubo
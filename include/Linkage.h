@@ -56,6 +56,7 @@
 // Includes
 //------------------------------------------------------------------------------
 #include "Frame.h"
+#include "NameTable.h"
 #include <string>
 #include <vector>
 #include <map>
@@ -107,6 +108,11 @@ namespace RobotKin {
         void setMass(double newMass, TRANSLATION newCom); // TODO
         void setInertiaTensor(Eigen::Matrix3d newInertiaTensor); // TODO
 
+        // Add the mass of a rigidly attached link whose frame is at offset
+        // with respect to this one. The tensors are taken about the center
+        // of mass of each link.
+        void merge(const Link& other, const TRANSFORM& offset);
+
         bool hasMass() const;
         bool hasTensor() const;
 
@@ -170,6 +176,8 @@ namespace RobotKin {
         // Joint Public Member Functions
         //----------------------------------------------------------------------
         double value() const;
+        // update is kept for compatibility and has no effect: frames are
+        // marked dirty here and recomputed when they are next read
         rk_result_t value(double newValue, bool update=true);
 
         double min() const;
@@ -177,15 +185,17 @@ namespace RobotKin {
         void min(double newMin);
         void max(double newMax);
 
-        JointType getJointType();
+        JointType getJointType() const;
 
         void setJointAxis(AXIS axis);
-        AXIS getJointAxis();
+        AXIS getJointAxis() const;
+        JointKernel getJointKernel() const;
 
         const TRANSFORM& respectToFixed() const;
         void respectToFixed(TRANSFORM aCoordinate);
 
         const TRANSFORM& respectToFixedTransformed() const;
+        TRANSFORM respectToFixedTransformed(double atValue) const; // Does not change the joint
 
         const TRANSFORM& respectToLinkage() const;
 
@@ -193,7 +203,7 @@ namespace RobotKin {
 
         TRANSFORM respectToRobot() const;
 
-        TRANSFORM respectToWorld() const;
+        const TRANSFORM& respectToWorld() const;
 
         Joint& parentJoint();
 
@@ -205,6 +215,16 @@ namespace RobotKin {
 
         size_t localID() const; // Joint ID inside its linkage
 
+        // Shared joint named "invalid", returned by failed non-const lookups.
+        // It is reset every time it is returned, so changes made to it are
+        // lost. Like the rest of the non-const interface it is not meant to
+        // be used from several threads at once.
+        static Joint& Invalid();
+
+        // Joint named "invalid" returned by failed const lookups. It is
+        // never written, so any number of threads may read it.
+        static const Joint& ConstInvalid();
+
         Linkage& linkage();
         Robot& robot();
 
@@ -228,10 +248,13 @@ namespace RobotKin {
         double min_; // Minimum joint value
         double max_; // Maximum joint value
         AXIS jointAxis_;
-        TRANSFORM respectToFixedTransformed_; // Coordinates transformed according to the joint value and type with respect to respectToFixed frame
-        TRANSFORM respectToLinkage_; // Coordinates with respect to linkage base frame
+        JointKernel kernel_; // Chosen from jointType_ and jointAxis_ by setJointAxis()
+        mutable TRANSFORM respectToFixedTransformed_; // Coordinates transformed according to the joint value and type with respect to respectToFixed frame
+        mutable TRANSFORM respectToLinkage_; // Coordinates with respect to linkage base frame
         size_t localID_;
 
+        void updateTransformed() const; // Recompute respectToFixedTransformed_ from value_
+
 
     }; // class Joint
 
@@ -270,7 +293,7 @@ namespace RobotKin {
 
         TRANSFORM respectToRobot() const;
 
-        TRANSFORM respectToWorld() const;
+        const TRANSFORM& respectToWorld() const;
 
         void printInfo() const;
 
@@ -302,7 +325,7 @@ namespace RobotKin {
         //----------------------------------------------------------------------
         // Tool Private Member Variables
         //----------------------------------------------------------------------
-        TRANSFORM respectToLinkage_; // Coordinates with respect to linkage base frame
+        mutable TRANSFORM respectToLinkage_; // Coordinates with respect to linkage base frame
 
     }; // class Tool
 
@@ -316,6 +339,8 @@ namespace RobotKin {
         friend class Joint;
         friend class Tool;
         friend class Robot;
+        friend class CompiledKinematics;
+        friend class RelativeTransforms;
         
     public:
 
@@ -378,6 +403,16 @@ namespace RobotKin {
 
 
         Linkage& parentLinkage();
+
+        // Shared linkage named "invalid", returned by failed non-const
+        // lookups. It is reset every time it is returned, so changes made to
+        // it are lost. Like the rest of the non-const interface it is not
+        // meant to be used from several threads at once.
+        static Linkage& Invalid();
+
+        // Linkage named "invalid" returned by failed const lookups. It is
+        // never written, so any number of threads may read it.
+        static const Linkage& ConstInvalid();
         
         size_t nChildren() const;
 
@@ -422,10 +457,26 @@ namespace RobotKin {
         
         const TRANSFORM& respectToRobot() const;
         
-        TRANSFORM respectToWorld() const;
+        const TRANSFORM& respectToWorld() const;
         
         void jacobian(Eigen::MatrixXd& J, TRANSLATION location, const Frame *refFrame) const;
         void jacobian(Eigen::MatrixXd& J, const std::vector<Joint*>& jointFrames, TRANSLATION location, const Frame* refFrame) const;
+
+        // Same as above, written into a caller-owned workspace that already
+        // has one column per joint, so nothing is allocated. The rotation into
+        // refFrame is skipped when refFrame is this linkage.
+        void jacobian(Eigen::Ref<Matrix6Xd> J, const TRANSLATION& location, const Frame* refFrame) const;
+        void jacobian(Eigen::Ref<Matrix6Xd> J, const std::vector<Joint*>& jointFrames,
+                      const TRANSLATION& location, const Frame* refFrame) const;
+
+        // Side-effect free forward kinematics for the joint values q. Fills
+        // framesRespectToLinkage with nJoints() joint frames followed by the
+        // tool frame. Joint limits are not imposed and nothing is cached.
+        void forwardKinematics(const Eigen::VectorXd& q, std::vector<TRANSFORM>& framesRespectToLinkage) const;
+
+        // Batched tool frames (respect to linkage), one per column of Q.
+        // Uses the vectorized chain composition of CompiledKinematics.
+        void batchForwardKinematics(const JointBatch& Q, std::vector<TRANSFORM>& toolPosesRespectToLinkage) const;
         
         void printInfo() const;
         
@@ -450,7 +501,7 @@ namespace RobotKin {
         // Linkage Protected Member Variables
         //--------------------------------------------------------------------------
         
-        TRANSFORM respectToRobot_; // Coordinates with respect to robot base frame
+        mutable TRANSFORM respectToRobot_; // Coordinates with respect to robot base frame
         Linkage* parentLinkage_;
         std::vector<Linkage*> childLinkages_;
         std::vector<Joint*> joints_;
@@ -467,8 +518,18 @@ namespace RobotKin {
         // Linkage Public Member Functions
         //--------------------------------------------------------------------------
         void initialize(std::vector<Joint> joints, Tool tool);
-        void updateFrames();
-        void updateChildLinkage();
+
+        // Frames are computed lazily: writes only mark them dirty, and the
+        // const accessors bring them up to date on the first read. Only the
+        // joints from firstDirtyJoint_ to the tool are recomputed.
+        void markDirty(size_t firstJoint=0); // Joint firstJoint and the ones after it changed
+        void markBaseDirty();                // respectToRobot_ of this linkage changed
+        void geometryChanged();              // A fixed transform or joint axis changed
+        void markChildrenDirty();            // Attachment frame (tool) of this linkage changed
+        void updateFrames() const;
+        void updateBase() const;
+        void composeBase() const;            // updateBase() for a linkage whose parent is up to date
+        void invalidateWorld() const;        // Clear the world frame cache of every frame
         static bool defaultAnalyticalIK(Eigen::VectorXd& q, const TRANSFORM& B, const Eigen::VectorXd& qPrev);
         
         
@@ -477,8 +538,13 @@ namespace RobotKin {
         // Linkage Private Member Variables
         //--------------------------------------------------------------------------
         bool initializing_;
-        bool needsUpdate_;
-        std::map<std::string, size_t> jointNameToIndex_;
+        mutable bool needsUpdate_;       // Joint and tool respectToLinkage_ are stale
+        mutable bool needsBaseUpdate_;   // respectToRobot_ is stale
+        mutable size_t firstDirtyJoint_; // First joint whose respectToLinkage_ is stale
+        mutable unsigned long revision_; // Changes whenever a frame with respect to this linkage changes
+        size_t depth_;                   // Number of ancestor linkages, set by Robot::addLinkage()
+        bool ownsJoints_;                // False once the joints live in the arena of a Robot
+        NameTable jointNameToIndex_;
         
         
     }; // class Linkage
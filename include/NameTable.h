@@ -0,0 +1,119 @@
+/*
+ -------------------------------------------------------------------------------
+ NameTable.h
+ Robot Library Project
+
+ CLASS NAME:
+ NameTable
+
+ DESCRIPTION:
+ Flat hash table from frame names to indices. Entries live in one array and
+ collisions are resolved by linear probing, so a lookup hashes the name once
+ and usually compares a single string, instead of the O(log n) string
+ compares of a std::map.
+
+ FILES:
+ NameTable.h
+ NameTable.cpp
+
+ DEPENDENCIES:
+ None
+
+ CONSTRUCTORS:
+ NameTable();
+
+ METHODS:
+ size_t find(const std::string& name) const;
+ Index stored for name, or NameTable::npos.
+
+ size_t at(const std::string& name) const;
+ Index stored for name. Throws std::out_of_range like std::map::at().
+
+ void insert(const std::string& name, size_t index);
+ Store index for name, replacing any previous index.
+
+ bool erase(const std::string& name);
+ Remove name. Returns false if it was not in the table.
+
+ NOTES:
+ Erased entries leave a tombstone behind until the next rehash.
+
+ -------------------------------------------------------------------------------
+ */
+
+
+
+#ifndef _NameTable_h_
+#define _NameTable_h_
+
+
+
+//------------------------------------------------------------------------------
+// Includes
+//------------------------------------------------------------------------------
+#include <vector>
+#include <string>
+
+
+namespace RobotKin {
+
+    class NameTable
+    {
+    public:
+        static const size_t npos = (size_t)-1;
+
+        //--------------------------------------------------------------------------
+        // NameTable Lifecycle
+        //--------------------------------------------------------------------------
+        NameTable();
+
+        //--------------------------------------------------------------------------
+        // NameTable Public Member Functions
+        //--------------------------------------------------------------------------
+        size_t find(const std::string& name) const;
+        size_t at(const std::string& name) const;
+        bool contains(const std::string& name) const;
+        void insert(const std::string& name, size_t index);
+        bool erase(const std::string& name);
+        void clear();
+        size_t size() const;
+
+    protected:
+        //--------------------------------------------------------------------------
+        // NameTable Protected Member Types
+        //--------------------------------------------------------------------------
+        enum SlotState { EMPTY, FULL, ERASED };
+
+        struct Slot
+        {
+            std::string name;
+            size_t hash;
+            size_t index;
+            SlotState state;
+        };
+
+        //--------------------------------------------------------------------------
+        // NameTable Protected Member Functions
+        //--------------------------------------------------------------------------
+        static size_t hash(const std::string& name);
+
+        // Slot holding name, or npos
+        size_t locate(const std::string& name, size_t h) const;
+
+        void rehash(size_t capacity);
+
+        //--------------------------------------------------------------------------
+        // NameTable Protected Member Variables
+        //--------------------------------------------------------------------------
+        std::vector<Slot> slots_; // Size is zero or a power of two
+        size_t size_;             // FULL slots
+        size_t used_;             // FULL and ERASED slots
+
+    }; // class NameTable
+
+} // namespace RobotKin
+
+#endif
+
+
+
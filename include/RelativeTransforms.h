@@ -0,0 +1,138 @@
+/*
+ -------------------------------------------------------------------------------
+ RelativeTransforms.h
+ Robot Library Project
+
+ CLASS NAME:
+ RelativeTransforms
+
+ DESCRIPTION:
+ Transform of one frame with respect to another, computed along the
+ kinematic tree instead of through the world frame. Both frames are carried
+ up the linkage tree (deepest first, using the depth of each linkage) until
+ they meet at their lowest common ancestor. Only the transforms on that path
+ are composed, and frames of the same linkage need a single relative
+ transform of their respectToLinkage() poses.
+
+ Pairs that are queried often (hand to head, tool to camera) can be
+ registered with addPair(). Their result is cached and only recomputed when
+ a linkage on the path between the two frames has changed.
+
+ FILES:
+ RelativeTransforms.h
+ RelativeTransforms.cpp
+
+ DEPENDENCIES:
+ Robot
+ Linkage
+
+ CONSTRUCTORS:
+ RelativeTransforms();
+
+ METHODS:
+ static TRANSFORM respectTo(const Frame& frame, const Frame& reference);
+ frame with respect to reference. Used by Frame::respectTo().
+
+ static const Linkage* lowestCommonAncestor(const Linkage* a, const Linkage* b);
+ Deepest linkage that contains both a and b, or NULL if they only meet at
+ the robot base. NULL arguments stand for the robot base.
+
+ size_t addPair(const Frame& frame, const Frame& reference);
+ Register a pair and return its index for pair().
+
+ const TRANSFORM& pair(size_t pairIndex) const;
+ Cached version of respectTo() for a registered pair.
+
+ NOTES:
+ Frames must belong to the same robot for the tree path to be used.
+ Otherwise respectTo() falls back to going through the world frames.
+
+ Registered frames must outlive the RelativeTransforms object.
+
+ -------------------------------------------------------------------------------
+ */
+
+
+
+#ifndef _RelativeTransforms_h_
+#define _RelativeTransforms_h_
+
+
+
+//------------------------------------------------------------------------------
+// Includes
+//------------------------------------------------------------------------------
+#include "Frame.h"
+#include "Linkage.h"
+#include "RigidTransform.h"
+#include <vector>
+#include <eigen3/Eigen/Core>
+#include <eigen3/Eigen/Geometry>
+
+
+namespace RobotKin {
+
+    class RelativeTransforms
+    {
+    public:
+        //--------------------------------------------------------------------------
+        // RelativeTransforms Lifecycle
+        //--------------------------------------------------------------------------
+        RelativeTransforms();
+
+        //--------------------------------------------------------------------------
+        // RelativeTransforms Public Member Functions
+        //--------------------------------------------------------------------------
+        static TRANSFORM respectTo(const Frame& frame, const Frame& reference);
+        static const Linkage* lowestCommonAncestor(const Linkage* a, const Linkage* b);
+
+        size_t addPair(const Frame& frame, const Frame& reference);
+        const TRANSFORM& pair(size_t pairIndex) const;
+        size_t nPairs() const;
+        void clearPairs();
+
+    protected:
+        //--------------------------------------------------------------------------
+        // RelativeTransforms Protected Member Types
+        //--------------------------------------------------------------------------
+        struct Pair
+        {
+            const Frame* frame;
+            const Frame* reference;
+            std::vector<const Linkage*> path;               // Every linkage between the two frames
+            mutable std::vector<unsigned long> revisions;   // Linkage revisions the transform was computed at
+            mutable TRANSFORM transform;
+        };
+
+        //--------------------------------------------------------------------------
+        // RelativeTransforms Protected Member Functions
+        //--------------------------------------------------------------------------
+        // Walk both frames up to their common ancestor. The linkages passed
+        // on the way are appended to path when it is not NULL.
+        static RigidTransform compose(const Frame& frame, const Frame& reference,
+                                      std::vector<const Linkage*>* path);
+
+        // Linkage the frame lives in, NULL for the robot base
+        static const Linkage* containingLinkage(const Frame& frame);
+
+        // Pose of the frame with respect to its containing linkage
+        static RigidTransform respectToContainer(const Frame& frame);
+
+        // Carry a pose from linkage to its parent linkage (or the robot base)
+        static const Linkage* raise(const Linkage* linkage, RigidTransform& pose);
+
+        static int depth(const Linkage* linkage);
+        static const Robot* robotOf(const Frame& frame);
+
+        //--------------------------------------------------------------------------
+        // RelativeTransforms Protected Member Variables
+        //--------------------------------------------------------------------------
+        std::vector<Pair> pairs_;
+
+    }; // class RelativeTransforms
+
+} // namespace RobotKin
+
+#endif
+
+
@@ -0,0 +1,159 @@
+/*
+ -------------------------------------------------------------------------------
+ RigidTransform.h
+ Robot Library Project
+
+ CLASS NAME:
+ RigidTransform
+
+ DESCRIPTION:
+ Rotation plus translation stored as 12 doubles. TRANSFORM (Isometry3d)
+ keeps the constant bottom row [0 0 0 1] in memory; RigidTransform does
+ not, and its inverse uses the transpose of the rotation instead of a
+ general 3x3 inverse.
+
+ Used internally by the kinematics code. Convert with the explicit
+ constructor and toIsometry() at the API boundary.
+
+ FILES:
+ RigidTransform.h
+
+ DEPENDENCIES:
+ Frame
+
+ CONSTRUCTORS:
+ RigidTransform();  // Uninitialized, like Eigen types
+ RigidTransform(const Eigen::Matrix3d& rotation, const TRANSLATION& translation);
+ explicit RigidTransform(const TRANSFORM& transform);
+
+ METHODS:
+ RigidTransform inverse() const;
+ Uses the transpose of the rotation.
+
+ RigidTransform inverseTimes(const RigidTransform& other) const;
+ Same as inverse()*other without building the inverse.
+
+ NOTES:
+ The rotation is assumed to be orthonormal.
+
+ -------------------------------------------------------------------------------
+ */
+
+
+
+#ifndef _RigidTransform_h_
+#define _RigidTransform_h_
+
+
+
+//------------------------------------------------------------------------------
+// Includes
+//------------------------------------------------------------------------------
+#include "Frame.h"
+#include <eigen3/Eigen/Core>
+#include <eigen3/Eigen/Geometry>
+
+
+namespace RobotKin {
+
+    class RigidTransform
+    {
+    public:
+        //--------------------------------------------------------------------------
+        // RigidTransform Lifecycle
+        //--------------------------------------------------------------------------
+        RigidTransform() { }
+
+        RigidTransform(const Eigen::Matrix3d& rotation, const TRANSLATION& translation)
+            : linear_(rotation),
+              translation_(translation)
+        { }
+
+        explicit RigidTransform(const TRANSFORM& transform)
+            : linear_(transform.linear()),
+              translation_(transform.translation())
+        { }
+
+        static RigidTransform Identity()
+        {
+            return RigidTransform(Eigen::Matrix3d::Identity(), TRANSLATION::Zero());
+        }
+
+        //--------------------------------------------------------------------------
+        // RigidTransform Public Member Functions
+        //--------------------------------------------------------------------------
+        TRANSFORM toIsometry() const
+        {
+            TRANSFORM transform;
+            transform.linear() = linear_;
+            transform.translation() = translation_;
+            transform.makeAffine();
+            return transform;
+        }
+
+        void setIdentity()
+        {
+            linear_.setIdentity();
+            translation_.setZero();
+        }
+
+        Eigen::Matrix3d& linear() { return linear_; }
+        const Eigen::Matrix3d& linear() const { return linear_; }
+        const Eigen::Matrix3d& rotation() const { return linear_; }
+
+        TRANSLATION& translation() { return translation_; }
+        const TRANSLATION& translation() const { return translation_; }
+
+        RigidTransform operator*(const RigidTransform& other) const
+        {
+            return RigidTransform(linear_*other.linear_, linear_*other.translation_ + translation_);
+        }
+
+        RigidTransform& operator*=(const RigidTransform& other)
+        {
+            translation_ += linear_*other.translation_;
+            linear_ = linear_*other.linear_;
+            return *this;
+        }
+
+        TRANSLATION operator*(const TRANSLATION& point) const
+        {
+            return linear_*point + translation_;
+        }
+
+        RigidTransform inverse() const
+        {
+            return RigidTransform(linear_.transpose(), -(linear_.transpose()*translation_));
+        }
+
+        RigidTransform inverseTimes(const RigidTransform& other) const
+        {
+            return RigidTransform(linear_.transpose()*other.linear_,
+                                  linear_.transpose()*(other.translation_ - translation_));
+        }
+
+    protected:
+        //--------------------------------------------------------------------------
+        // RigidTransform Protected Member Variables
+        //--------------------------------------------------------------------------
+        Eigen::Matrix3d linear_;
+        TRANSLATION translation_;
+
+    }; // class RigidTransform
+
+
+    // Compose an Isometry3d with a RigidTransform without touching the bottom row
+    inline TRANSFORM operator*(const TRANSFORM& lhs, const RigidTransform& rhs)
+    {
+        TRANSFORM result;
+        result.linear() = lhs.linear()*rhs.linear();
+        result.translation() = lhs.linear()*rhs.translation() + lhs.translation();
+        result.makeAffine();
+        return result;
+    }
+
+} // namespace RobotKin
+
+#endif
+
+
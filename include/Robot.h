@@ -62,7 +62,9 @@
 #include <string>
 #include <eigen3/Eigen/Core>
 #include <eigen3/Eigen/Geometry>
+#include <eigen3/Eigen/StdVector>
 #include "Constraints.h"
+#include "Arena.h"
 
 
 
@@ -76,6 +78,50 @@ namespace RobotKin {
     //------------------------------------------------------------------------------
     typedef Eigen::Matrix<double, 6, Eigen::Dynamic> Matrix6Xd;
 
+    // Frame removed by Robot::collapseAnchors(), rigidly attached to host
+    struct CollapsedFrame {
+        const Frame* host;  // NULL for names that were never collapsed
+        TRANSFORM offset; // Pose of the removed frame with respect to host
+    };
+
+    // Jacobian of a point on one frame from Robot::frameJacobian(). Only the
+    // joints that move the frame get a column: column i belongs to robot
+    // joint jointIndices[i] (ascending), and every other joint of the robot
+    // has an implicit zero column.
+    struct FrameJacobian {
+        std::vector<size_t> jointIndices;
+        std::vector<Joint*> joints;
+        Matrix6Xd J;
+    };
+
+    class RobotSnapshot;
+
+    // Handles are resolved from names once and then used in place of the
+    // names. A handle is only valid for the robot that made it, and only
+    // until joints or linkages of that robot are added, removed or
+    // reordered. See Robot::isValid().
+    struct JointHandle {
+        JointHandle() : index(0), robot(NULL), layout(0) {}
+        size_t index;          // Index into Robot::joints()
+        const Robot* robot;
+        unsigned long layout;  // Robot layout the handle was made for
+    };
+
+    struct LinkageHandle {
+        LinkageHandle() : index(0), robot(NULL), layout(0) {}
+        size_t index;          // Index into Robot::linkages()
+        const Robot* robot;
+        unsigned long layout;
+    };
+
+    struct JointGroupHandle {
+        JointGroupHandle() : linkage(-1), robot(NULL), layout(0) {}
+        std::vector<size_t> indices; // Robot joint indices, in chain order
+        int linkage;                 // Linkage the group was made from, -1 for none
+        const Robot* robot;
+        unsigned long layout;
+    };
+
 	// Sort parentIndices and linkages
     struct indexParentIndexPair {
         size_t I;
@@ -104,6 +150,12 @@ namespace RobotKin {
         Robot();
         Robot(std::vector<Linkage> linkageObjs, std::vector<int> parentIndices);
 
+        // Copies the whole robot, including its joint values and the frames
+        // already computed from them, without parsing or recomputing
+        // anything. The copy is independent of robot: editing either one
+        // (values or geometry) does not affect the other.
+        Robot(const Robot& robot);
+
         Robot(std::string filename, std::string name="", size_t id=0);
         bool loadURDF(std::string filename);
         bool loadURDFString(std::string filename);
@@ -120,6 +172,9 @@ namespace RobotKin {
         //--------------------------------------------------------------------------
         // Robot Public Member Functions
         //--------------------------------------------------------------------------
+        // Heap allocated copy, see Robot(const Robot&). The caller owns it.
+        virtual Robot* clone() const;
+
         size_t nLinkages() const;
         
         size_t linkageIndex(std::string linkageName) const;
@@ -160,6 +215,23 @@ namespace RobotKin {
         // Convenience function
         rk_result_t setJointValue(size_t jointIndex, double val, bool update=true);
         rk_result_t setJointValue(std::string jointName, double val, bool update=true);
+
+        // Name lookups resolved once. Invalid names give handles for which
+        // isValid() is false.
+        JointHandle jointHandle(std::string jointName) const;
+        LinkageHandle linkageHandle(std::string linkageName) const;
+        JointGroupHandle jointGroupHandle(const std::vector<std::string>& jointNames) const;
+        JointGroupHandle jointGroupHandle(const LinkageHandle& linkage) const;
+
+        bool isValid(const JointHandle& handle) const;
+        bool isValid(const LinkageHandle& handle) const;
+        bool isValid(const JointGroupHandle& handle) const;
+
+        const Joint& const_joint(const JointHandle& handle) const;
+        Joint& joint(const JointHandle& handle);
+        const Linkage& const_linkage(const LinkageHandle& handle) const;
+        Linkage& linkage(const LinkageHandle& handle);
+        rk_result_t setJointValue(const JointHandle& handle, double val, bool update=true);
         
         const std::vector<Joint*>& const_joints() const;
         std::vector<Joint*>& joints();
@@ -167,17 +239,97 @@ namespace RobotKin {
         Eigen::VectorXd values() const;
         void values(const Eigen::VectorXd& allValues);
         void values(const std::vector<size_t> &jointIndices, const Eigen::VectorXd& jointValues);
+        Eigen::VectorXd values(const JointGroupHandle& group) const;
+        void values(const JointGroupHandle& group, const Eigen::VectorXd& jointValues);
         
         const TRANSFORM& respectToFixed() const;
         void respectToFixed(TRANSFORM aCoordinate);
         
-        TRANSFORM respectToWorld() const;
+        const TRANSFORM& respectToWorld() const;
 	void respectToWorld(TRANSFORM Tworld );
         
         void jacobian(Eigen::MatrixXd& J, const std::vector<Joint*>& jointFrames, TRANSLATION location, const Frame* refFrame) const;
+
+        // Same as above, written into a caller-owned workspace that already
+        // has one column per joint, so nothing is allocated. The rotation into
+        // refFrame is skipped when refFrame is the robot.
+        void jacobian(Eigen::Ref<Matrix6Xd> J, const std::vector<Joint*>& jointFrames,
+                      const TRANSLATION& location, const Frame* refFrame) const;
+
+        // Jacobian of point (given in the coordinates of frame) over every
+        // joint that moves frame, found by walking up the parent linkages.
+        // The first version keeps only those columns and reuses the storage
+        // of result; the second scatters them into a 6 x nJoints() matrix.
+        void frameJacobian(FrameJacobian& result, const Frame& frame,
+                           const TRANSLATION& point, const Frame* refFrame) const;
+        void frameJacobian(Eigen::MatrixXd& J, const Frame& frame,
+                           const TRANSLATION& point, const Frame* refFrame) const;
+
+        // Time derivative of jacobian() for the joints jointIndices moving
+        // with velocities qdot (one per index), so that the acceleration of
+        // location is J*qddot + Jdot*qdot. As for the IK solvers, location is
+        // carried by the joints, which form a chain to it in any order. The
+        // second version also returns J from the same pass. refFrame is taken
+        // as fixed to the robot, so only the robot (or world) frame gives the
+        // true derivative.
+        void jacobianDot(Eigen::MatrixXd& Jdot, const std::vector<size_t>& jointIndices,
+                         const Eigen::VectorXd& qdot, const TRANSLATION& location,
+                         const Frame* refFrame) const;
+        void jacobianDot(Eigen::MatrixXd& J, Eigen::MatrixXd& Jdot, const std::vector<size_t>& jointIndices,
+                         const Eigen::VectorXd& qdot, const TRANSLATION& location,
+                         const Frame* refFrame) const;
+
+        // Kinematic Hessian of the same chain: H[j] is the derivative of
+        // jacobian() with respect to the value of joint jointIndices[j].
+        // H is resized to one 6 x n matrix per joint and its storage reused.
+        void hessian(std::vector<Matrix6Xd>& H, const std::vector<size_t>& jointIndices,
+                     const TRANSLATION& location, const Frame* refFrame) const;
+
+        // Side-effect free forward kinematics for the full joint vector q.
+        // jointPoses gets one frame per robot joint and toolPoses one frame
+        // per linkage, all with respect to the robot. Joint limits are not
+        // imposed and the robot itself is never modified, so these may be
+        // called from several threads at once.
+        void forwardKinematics(const Eigen::VectorXd& q, std::vector<TRANSFORM>& jointPoses) const;
+        void forwardKinematics(const Eigen::VectorXd& q, std::vector<TRANSFORM>& jointPoses,
+                               std::vector<TRANSFORM>& toolPoses) const;
         
         void updateFrames();
         void printInfo() const;
+
+        // Model reduction: remove every ANCHOR joint, folding its fixed
+        // transform into the next joint of its linkage (or the tool) and its
+        // link into the link it is rigidly attached to. Returns the number of
+        // joints removed. Joint indices change, so call this right after the
+        // model is loaded. The names of the removed frames only resolve
+        // through isCollapsed(), collapsedFrame() and collapsedRespectTo():
+        // joint(), jointIndex() and Linkage::joint() treat them as unknown
+        // names, so callers that look sensor or mount frames up by name must
+        // switch to collapsedRespectTo().
+        size_t collapseAnchors();
+        bool isCollapsed(std::string frameName) const;
+        const CollapsedFrame& collapsedFrame(std::string frameName) const;
+        TRANSFORM collapsedRespectTo(std::string frameName, const Frame* refFrame) const;
+
+        // Batched joint writes: between beginUpdate() and commit() joint
+        // writes are only limit-checked and stored, and the frames of every
+        // affected linkage are propagated exactly once when the outermost
+        // commit() is reached. See also JointWriteBatch.
+        void beginUpdate();
+        void commit();
+        bool updating() const;
+
+        // Save the joint values, the frames computed from them and the
+        // imposeLimits flag, and put them back later without recomputing
+        // anything. The second version only saves one linkage and its
+        // descendants, which is all a change to that linkage can touch; its
+        // base still follows the parent linkage as it is at restore time.
+        // restore() fails for a snapshot of another robot, or one taken
+        // before joints or linkages were added or removed, or before a
+        // fixed transform or a joint axis was changed.
+        void snapshot(RobotSnapshot& snapshot) const;
+        void snapshot(RobotSnapshot& snapshot, size_t linkageIndex) const;
+        bool restore(const RobotSnapshot& snapshot);
         
         //--------------------------------------------------------------------------
         // Kinematics Solvers
@@ -192,6 +344,9 @@ namespace RobotKin {
         rk_result_t selectivelyDampedLeastSquaresIK_linkage(const std::string linkageName, Eigen::VectorXd &jointValues,
                                          const TRANSFORM& target, const TRANSFORM &finalTF = TRANSFORM::Identity());
 
+        rk_result_t selectivelyDampedLeastSquaresIK(const JointGroupHandle& group, Eigen::VectorXd &jointValues,
+                                         const TRANSFORM& target, const TRANSFORM &finalTF = TRANSFORM::Identity());
+
 
         //////////////////
 
@@ -204,6 +359,9 @@ namespace RobotKin {
         rk_result_t pseudoinverseIK_linkage(const std::string linkageName, Eigen::VectorXd &jointValues,
                                             const TRANSFORM& target, const TRANSFORM &finalTF = TRANSFORM::Identity());
 
+        rk_result_t pseudoinverseIK(const JointGroupHandle& group, Eigen::VectorXd &jointValues,
+                                    const TRANSFORM& target, const TRANSFORM &finalTF = TRANSFORM::Identity());
+
         //////////////////
 
         rk_result_t jacobianTransposeIK_chain(const std::vector<size_t> &jointIndices, Eigen::VectorXd &jointValues,
@@ -215,16 +373,34 @@ namespace RobotKin {
         rk_result_t jacobianTransposeIK_linkage(const std::string linkageName, Eigen::VectorXd &jointValues,
                                             const TRANSFORM& target, const TRANSFORM &finalTF = TRANSFORM::Identity());
 
+        rk_result_t jacobianTransposeIK(const JointGroupHandle& group, Eigen::VectorXd &jointValues,
+                                        const TRANSFORM& target, const TRANSFORM &finalTF = TRANSFORM::Identity());
+
         /////////////////
 
         rk_result_t dampedLeastSquaresIK_chain(const std::vector<size_t> &jointIndices, Eigen::VectorXd &jointValues,
-                                               const TRANSFORM &target, RobotKin::Constraints& constraints=RobotKin::Constraints::Defaults());
+                                               const TRANSFORM &target, RobotKin::Constraints& constraints);
 
         rk_result_t dampedLeastSquaresIK_chain(const std::vector<std::string>& jointNames, Eigen::VectorXd& jointValues,
-                                               const TRANSFORM& target, RobotKin::Constraints& constraints=RobotKin::Constraints::Defaults());
+                                               const TRANSFORM& target, RobotKin::Constraints& constraints);
+
+        rk_result_t dampedLeastSquaresIK_linkage(const std::string linkageName, Eigen::VectorXd &jointValues,
+                                                 const TRANSFORM& target, RobotKin::Constraints& constraints);
+
+        // Groups made from a linkage set constraints.finalTransform to the
+        // tool of the linkage, like dampedLeastSquaresIK_linkage()
+        rk_result_t dampedLeastSquaresIK(const JointGroupHandle& group, Eigen::VectorXd &jointValues,
+                                         const TRANSFORM& target, RobotKin::Constraints& constraints);
 
+        // The same solvers with a fresh set of default Constraints
+        rk_result_t dampedLeastSquaresIK_chain(const std::vector<size_t> &jointIndices, Eigen::VectorXd &jointValues,
+                                               const TRANSFORM &target);
+        rk_result_t dampedLeastSquaresIK_chain(const std::vector<std::string>& jointNames, Eigen::VectorXd& jointValues,
+                                               const TRANSFORM& target);
         rk_result_t dampedLeastSquaresIK_linkage(const std::string linkageName, Eigen::VectorXd &jointValues,
-                                                 const TRANSFORM& target, RobotKin::Constraints& constraints=RobotKin::Constraints::Defaults());
+                                                 const TRANSFORM& target);
+        rk_result_t dampedLeastSquaresIK(const JointGroupHandle& group, Eigen::VectorXd &jointValues,
+                                         const TRANSFORM& target);
 
         /////////////////
 
@@ -238,6 +414,14 @@ namespace RobotKin {
         //^ Type of Indices can be Joint or Linkage
         double mass(const std::vector<std::string> &names, FrameType typeOfIndex=JOINT);
         //^ Type of Indices can be Joint or Linkage
+        TRANSLATION centerOfMass(const JointGroupHandle& group, FrameType withRespectTo=WORLD);
+        double mass(const JointGroupHandle& group);
+
+        // Derivative of centerOfMass() (entire robot + tools) with respect to
+        // the joints jointIndices, or to every joint, as a 3 x n matrix in
+        // the coordinates of refFrame
+        void centerOfMassJacobian(Eigen::MatrixXd& J, const std::vector<size_t>& jointIndices, const Frame* refFrame) const;
+        void centerOfMassJacobian(Eigen::MatrixXd& J, const Frame* refFrame) const;
 
         /////////////////
 
@@ -246,21 +430,41 @@ namespace RobotKin {
 
         static Robot& Default();
 
+        // Shared robot named "invalid", returned by failed lookups. It is
+        // rebuilt every time it is returned, so changes made to it are lost.
+        static Robot& Invalid();
+
     protected:
         //--------------------------------------------------------------------------
         // Robot Protected Member Functions
         //--------------------------------------------------------------------------
         TRANSFORM respectToWorld_; // Coordinates with respect to robot base frame
-        std::vector<Linkage*> linkages_;
-        std::map<std::string, size_t> linkageNameToIndex_;
+        Arena<Linkage> linkageArena_; // Storage of every linkage (and its tool), in linkages_ order
+        Arena<Joint> jointArena_;     // Storage of every joint, in joints_ order
+        std::vector<Linkage*> linkages_; // Parents always come before their children
+        NameTable linkageNameToIndex_;
         std::vector<Joint*> joints_;
-        std::map<std::string, size_t> jointNameToIndex_;
+        NameTable jointNameToIndex_;
+        std::map<std::string, CollapsedFrame> collapsedFrames_;
         
         
         //--------------------------------------------------------------------------
         // Robot Protected Member Variables
         //--------------------------------------------------------------------------
         virtual void initialize(std::vector<Linkage> linkageObjs, std::vector<int> parentIndices);
+
+        // Rebuild the linkages and joints of robot in this robot's arenas
+        void copyStructure(const Robot& robot);
+
+        // Whether the value of mover changes the frame of joint
+        static bool moves(const Joint& mover, const Joint& joint);
+
+        // Save one linkage and its joints into the given records of snapshot
+        void saveLinkage(RobotSnapshot& snapshot, size_t linkageIndex,
+                         size_t linkageRecord, size_t& jointRecord) const;
+
+        TRANSFORM forwardKinematicsTool(size_t linkageIndex, const std::vector<TRANSFORM>& jointPoses) const;
+        TRANSFORM forwardKinematicsBase(size_t linkageIndex, const std::vector<TRANSFORM>& jointPoses) const;
         
         
     private:
@@ -275,10 +479,105 @@ namespace RobotKin {
         // Robot Private Member Variables
         //--------------------------------------------------------------------------
         bool initializing_;
+        size_t updateDepth_;
+        unsigned long layout_; // Changes whenever joints or linkages are added, removed or reordered
+        unsigned long geometry_; // Changes whenever a fixed transform or a joint axis changes
+
+        Robot& operator=(const Robot& robot); // Not implemented
         
         
         
     }; // class Robot
+
+
+    // Scoped version of Robot::beginUpdate() / Robot::commit()
+    class JointWriteBatch
+    {
+    public:
+        JointWriteBatch(Robot& robot);
+        ~JointWriteBatch();
+
+        void commit();
+
+    private:
+        JointWriteBatch(const JointWriteBatch&);
+        JointWriteBatch& operator=(const JointWriteBatch&);
+
+        Robot& robot_;
+        bool open_;
+
+    }; // class JointWriteBatch
+
+
+    // Saved state for Robot::snapshot() / Robot::restore(). Reusing one
+    // snapshot for many try-and-rollback steps avoids any allocation after
+    // the first one.
+    class RobotSnapshot
+    {
+        friend class Robot;
+
+    public:
+        RobotSnapshot();
+
+        bool empty() const;
+        size_t nJoints() const;    // Joints saved
+        size_t nLinkages() const;  // Linkages saved
+
+    protected:
+        struct JointRecord
+        {
+            TRANSFORM respectToFixedTransformed;
+            TRANSFORM respectToLinkage;
+            double value;
+        };
+
+        struct LinkageRecord
+        {
+            TRANSFORM respectToRobot;
+            TRANSFORM toolRespectToLinkage;
+            size_t linkage;
+            bool needsUpdate;
+            bool needsBaseUpdate;
+            size_t firstDirtyJoint;
+        };
+
+        // The records hold fixed-size Eigen members, which need aligned storage
+        std::vector<LinkageRecord, Eigen::aligned_allocator<LinkageRecord> > linkages_;
+        std::vector<JointRecord, Eigen::aligned_allocator<JointRecord> > joints_; // Joints of each saved linkage, in linkage order
+        const Robot* robot_;
+        unsigned long layout_;
+        unsigned long geometry_;
+        bool imposeLimits_;
+
+    }; // class RobotSnapshot
+
+
+    // A Robot as solved by RobotKin::dampedLeastSquaresIK()
+    class RobotKinematicState : public KinematicState
+    {
+    public:
+        RobotKinematicState(Robot& robot);
+
+        double min(size_t jointIndex) const;
+        double max(size_t jointIndex) const;
+        JointType jointType(size_t jointIndex) const;
+
+        double value(size_t jointIndex) const;
+        void values(const std::vector<size_t>& jointIndices, const Eigen::VectorXd& jointValues);
+        TRANSFORM jointRespectToRobot(size_t jointIndex) const;
+        void jacobian(Eigen::MatrixXd& J, const std::vector<size_t>& jointIndices, const TRANSLATION& location);
+
+        bool getImposeLimits() const;
+        void setImposeLimits(bool imposeLimits);
+        bool verbose() const;
+
+        Robot* robot();
+
+    protected:
+        Robot& robot_;
+        std::vector<Joint*> joints_; // Reused by jacobian()
+
+    }; // class RobotKinematicState
     
     //------------------------------------------------------------------------------
     // Postfix Increment Operators
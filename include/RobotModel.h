@@ -0,0 +1,257 @@
+/*
+ -------------------------------------------------------------------------------
+ RobotModel.h
+ Robot Library Project
+
+ CLASS NAME:
+ RobotModel, RobotState
+
+ DESCRIPTION:
+ RobotModel is an immutable description of a robot: the compiled kinematic
+ tree, joint limits, names and mass properties. It is built once from a
+ Robot (or a URDF file) and can then be shared by any number of threads.
+
+ RobotState holds everything that changes while solving: the joint values
+ and the cached frames computed from them. A state refers to its model but
+ never modifies it, so each thread can own its own state.
+
+ FILES:
+ RobotModel.h
+ RobotModel.cpp
+ Solvers.cpp
+
+ DEPENDENCIES:
+ Robot
+ CompiledKinematics
+ Constraints
+
+ CONSTRUCTORS:
+ RobotModel();
+ RobotModel(const Robot& robot);
+ RobotModel(std::string filename);
+
+ RobotState(const RobotModel& model);
+
+ PROPERTIES:
+ imposeLimits - (RobotState) Clamp joint writes to the joint limits.
+
+ METHODS:
+ rk_result_t RobotModel::dampedLeastSquaresIK_chain(RobotState& state, ...) const;
+ Same solver as Robot::dampedLeastSquaresIK_chain(), but every joint value
+ and frame lives in state.
+
+ const TRANSFORM& RobotState::jointRespectToRobot(size_t jointIndex) const;
+ Frames are recomputed in a single pass the first time one is read after
+ the joint values changed.
+
+ NOTES:
+ A RobotModel is a snapshot. Changes made to the Robot afterwards are not
+ seen by the model.
+
+ A RobotState must not outlive its model, and must not be shared between
+ threads without locking. Constraints also carry solver state (the final
+ transform and the null space flags), so give each thread its own copy.
+
+ EXAMPLES:
+ Example 1: one model, one state per thread
+ ----------------------------------------------------------------------------
+ RobotModel model(hubo);
+ // in each thread
+ RobotState state(model);
+ Constraints constraints;
+ model.dampedLeastSquaresIK_linkage(state, "LEFT_ARM", q, target, constraints);
+ ----------------------------------------------------------------------------
+
+ -------------------------------------------------------------------------------
+ */
+
+
+
+#ifndef _RobotModel_h_
+#define _RobotModel_h_
+
+
+
+//------------------------------------------------------------------------------
+// Includes
+//------------------------------------------------------------------------------
+#include "Frame.h"
+#include "Linkage.h"
+#include "CompiledKinematics.h"
+#include "Constraints.h"
+#include <vector>
+#include <map>
+#include <string>
+#include <eigen3/Eigen/Core>
+#include <eigen3/Eigen/Geometry>
+
+
+namespace RobotKin {
+
+    class RobotState;
+
+    class RobotModel
+    {
+    public:
+        //--------------------------------------------------------------------------
+        // RobotModel Lifecycle
+        //--------------------------------------------------------------------------
+        RobotModel();
+        RobotModel(const Robot& robot);
+        RobotModel(std::string filename);
+
+        void build(const Robot& robot);
+
+        //--------------------------------------------------------------------------
+        // RobotModel Public Member Functions
+        //--------------------------------------------------------------------------
+        std::string name() const;
+
+        size_t nJoints() const;
+        size_t nLinkages() const;
+
+        // Name lookups return nJoints() / nLinkages() for unknown names
+        size_t jointIndex(std::string jointName) const;
+        size_t linkageIndex(std::string linkageName) const;
+        const std::string& jointName(size_t jointIndex) const;
+        const std::string& linkageName(size_t linkageIndex) const;
+
+        rk_result_t jointNamesToIndices(const std::vector<std::string>& jointNames,
+                                        std::vector<size_t>& jointIndices) const;
+
+        // Robot joint indices of the joints in a linkage, base to tip
+        const std::vector<size_t>& linkageJoints(size_t linkageIndex) const;
+
+        double min(size_t jointIndex) const;
+        double max(size_t jointIndex) const;
+        JointType jointType(size_t jointIndex) const;
+
+        // Mass properties of each frame of kinematics(), in the frame itself
+        const Link& link(size_t frame) const;
+        const Link& rootLink() const;
+
+        const TRANSFORM& respectToWorld() const;
+        const CompiledKinematics& kinematics() const;
+
+        // Jacobian of the given joints at location (respect to robot), with
+        // the joint frames taken from state
+        void jacobian(Eigen::MatrixXd& J, const RobotState& state,
+                      const std::vector<size_t>& jointIndices, const TRANSLATION& location) const;
+
+        //--------------------------------------------------------------------------
+        // Kinematics Solvers
+        //--------------------------------------------------------------------------
+        rk_result_t dampedLeastSquaresIK_chain(RobotState& state, const std::vector<size_t>& jointIndices,
+                                               Eigen::VectorXd& jointValues, const TRANSFORM& target,
+                                               RobotKin::Constraints& constraints) const;
+
+        rk_result_t dampedLeastSquaresIK_chain(RobotState& state, const std::vector<std::string>& jointNames,
+                                               Eigen::VectorXd& jointValues, const TRANSFORM& target,
+                                               RobotKin::Constraints& constraints) const;
+
+        rk_result_t dampedLeastSquaresIK_linkage(RobotState& state, const std::string linkageName,
+                                                 Eigen::VectorXd& jointValues, const TRANSFORM& target,
+                                                 RobotKin::Constraints& constraints) const;
+
+        // The same solvers with a fresh set of default Constraints
+        rk_result_t dampedLeastSquaresIK_chain(RobotState& state, const std::vector<size_t>& jointIndices,
+                                               Eigen::VectorXd& jointValues, const TRANSFORM& target) const;
+        rk_result_t dampedLeastSquaresIK_chain(RobotState& state, const std::vector<std::string>& jointNames,
+                                               Eigen::VectorXd& jointValues, const TRANSFORM& target) const;
+        rk_result_t dampedLeastSquaresIK_linkage(RobotState& state, const std::string linkageName,
+                                                 Eigen::VectorXd& jointValues, const TRANSFORM& target) const;
+
+    protected:
+        //--------------------------------------------------------------------------
+        // RobotModel Protected Member Variables
+        //--------------------------------------------------------------------------
+        std::string name_;
+        CompiledKinematics kinematics_;
+        TRANSFORM respectToWorld_;
+
+        std::vector<std::string> jointNames_;
+        std::vector<std::string> linkageNames_;
+        NameTable jointNameToIndex_;
+        NameTable linkageNameToIndex_;
+        std::vector< std::vector<size_t> > linkageJoints_;
+
+        std::vector<Link> links_;
+        Link rootLink_;
+
+    }; // class RobotModel
+
+
+    class RobotState
+    {
+    public:
+        //--------------------------------------------------------------------------
+        // RobotState Lifecycle
+        //--------------------------------------------------------------------------
+        RobotState(const RobotModel& model);
+
+        bool imposeLimits;
+
+        //--------------------------------------------------------------------------
+        // RobotState Public Member Functions
+        //--------------------------------------------------------------------------
+        const RobotModel& model() const;
+        size_t nJoints() const;
+
+        double value(size_t jointIndex) const;
+        rk_result_t value(size_t jointIndex, double newValue);
+
+        const Eigen::VectorXd& values() const;
+        void values(const Eigen::VectorXd& allValues);
+        void values(const std::vector<size_t>& jointIndices, const Eigen::VectorXd& jointValues);
+
+        // Frames with respect to the robot, recomputed lazily
+        const TRANSFORM& jointRespectToRobot(size_t jointIndex) const;
+        const TRANSFORM& toolRespectToRobot(size_t linkageIndex) const;
+        const TRANSFORM& linkageRespectToRobot(size_t linkageIndex) const;
+        const std::vector<TRANSFORM>& frames() const;
+
+        void updateFrames() const;
+
+    protected:
+        //--------------------------------------------------------------------------
+        // RobotState Protected Member Variables
+        //--------------------------------------------------------------------------
+        const RobotModel* model_;
+        Eigen::VectorXd values_;
+
+        mutable std::vector<TRANSFORM> frames_;
+        mutable bool needsUpdate_;
+
+    }; // class RobotState
+
+
+    // A RobotState as solved by RobotKin::dampedLeastSquaresIK()
+    class ModelKinematicState : public KinematicState
+    {
+    public:
+        ModelKinematicState(RobotState& state);
+
+        double min(size_t jointIndex) const;
+        double max(size_t jointIndex) const;
+        JointType jointType(size_t jointIndex) const;
+
+        double value(size_t jointIndex) const;
+        void values(const std::vector<size_t>& jointIndices, const Eigen::VectorXd& jointValues);
+        TRANSFORM jointRespectToRobot(size_t jointIndex) const;
+        void jacobian(Eigen::MatrixXd& J, const std::vector<size_t>& jointIndices, const TRANSLATION& location);
+
+        bool getImposeLimits() const;
+        void setImposeLimits(bool imposeLimits);
+
+        RobotState* robotState();
+
+    protected:
+        RobotState& state_;
+
+    }; // class ModelKinematicState
+
+} // namespace RobotKin
+
+#endif
+
+
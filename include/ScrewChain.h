@@ -0,0 +1,146 @@
+/*
+ -------------------------------------------------------------------------------
+ ScrewChain.h
+ Robot Library Project
+
+ CLASS NAME:
+ ScrewChain
+
+ DESCRIPTION:
+ Serial chain described by the spatial screw axis of each joint in the home
+ configuration (every chain joint at zero). Forward kinematics is the
+ product of exponentials
+
+     T(q) = exp([S_1]q_1) * ... * exp([S_n]q_n) * M
+
+ and column i of the space Jacobian is S_i moved by the adjoint of the
+ product of the first i-1 exponentials. Both come out of the same pass, so
+ an IK iteration that needs the pose and the Jacobian pays for one sweep
+ instead of two.
+
+ Screws use the ordering of the rest of the library: linear part in rows
+ 0-2, angular part in rows 3-5.
+
+ FILES:
+ ScrewChain.h
+ ScrewChain.cpp
+
+ DEPENDENCIES:
+ CompiledKinematics
+ Robot
+ Linkage
+
+ CONSTRUCTORS:
+ ScrewChain();
+ ScrewChain(const Linkage& linkage);
+ ScrewChain(const Robot& robot, const std::vector<size_t>& jointIndices,
+            const TRANSFORM& finalTransform=TRANSFORM::Identity());
+
+ METHODS:
+ bool build(const CompiledKinematics& kinematics, const Eigen::VectorXd& values,
+            const std::vector<size_t>& jointIndices, const TRANSFORM& finalTransform);
+ Compute the screws from the frames of kinematics at values, with the chain
+ joints set to zero. The end effector is finalTransform with respect to
+ the last joint of the chain. Returns false for invalid joint indices.
+
+ void forwardKinematics(const Eigen::VectorXd& q, TRANSFORM& pose) const;
+ End effector with respect to the base of the chain.
+
+ void spaceJacobian(const Eigen::VectorXd& q, Matrix6Xd& J, TRANSFORM& pose) const;
+ void bodyJacobian(const Eigen::VectorXd& q, Matrix6Xd& J, TRANSFORM& pose) const;
+ Space or body Jacobian (twists) together with the end effector pose.
+
+ void jacobian(const Eigen::VectorXd& q, Matrix6Xd& J, TRANSFORM& pose) const;
+ Jacobian at the end effector expressed in the base frame, the same
+ convention as Robot::jacobian() and Linkage::jacobian().
+
+ NOTES:
+ The chain is built from the joint values given to build(), so joints that
+ are not part of the chain stay frozen at those values. Rebuild the chain
+ when they move.
+
+ The base of the chain is the robot frame, or the linkage frame for a chain
+ built from a Linkage.
+
+ -------------------------------------------------------------------------------
+ */
+
+
+
+#ifndef _ScrewChain_h_
+#define _ScrewChain_h_
+
+
+
+//------------------------------------------------------------------------------
+// Includes
+//------------------------------------------------------------------------------
+#include "Frame.h"
+#include "Linkage.h"
+#include "RigidTransform.h"
+#include <vector>
+#include <eigen3/Eigen/Core>
+#include <eigen3/Eigen/Geometry>
+
+
+namespace RobotKin {
+
+    class CompiledKinematics;
+
+    class ScrewChain
+    {
+    public:
+        //--------------------------------------------------------------------------
+        // ScrewChain Lifecycle
+        //--------------------------------------------------------------------------
+        ScrewChain();
+        ScrewChain(const Linkage& linkage);
+        ScrewChain(const Robot& robot, const std::vector<size_t>& jointIndices,
+                   const TRANSFORM& finalTransform=TRANSFORM::Identity());
+
+        bool build(const CompiledKinematics& kinematics, const Eigen::VectorXd& values,
+                   const std::vector<size_t>& jointIndices, const TRANSFORM& finalTransform);
+
+        //--------------------------------------------------------------------------
+        // ScrewChain Public Member Functions
+        //--------------------------------------------------------------------------
+        size_t nJoints() const;
+        size_t jointIndex(size_t i) const;
+        SCREW spaceScrew(size_t i) const;
+        TRANSFORM home() const;
+
+        void forwardKinematics(const Eigen::VectorXd& q, TRANSFORM& pose) const;
+        void spaceJacobian(const Eigen::VectorXd& q, Matrix6Xd& J, TRANSFORM& pose) const;
+        void bodyJacobian(const Eigen::VectorXd& q, Matrix6Xd& J, TRANSFORM& pose) const;
+        void jacobian(const Eigen::VectorXd& q, Matrix6Xd& J, TRANSFORM& pose) const;
+
+        // exp([S]theta) for a screw with a unit angular part, or a zero
+        // angular part and a unit linear part
+        static RigidTransform exponential(const SCREW& screw, double theta);
+
+        // Express a twist given in the frame of T in the frame T is given in
+        static SCREW adjoint(const RigidTransform& T, const SCREW& twist);
+
+        EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+    protected:
+        //--------------------------------------------------------------------------
+        // ScrewChain Protected Member Functions
+        //--------------------------------------------------------------------------
+        // Fill J with the space Jacobian and return the end effector pose
+        RigidTransform sweep(const Eigen::VectorXd& q, Matrix6Xd* J) const;
+
+        //--------------------------------------------------------------------------
+        // ScrewChain Protected Member Variables
+        //--------------------------------------------------------------------------
+        Matrix6Xd screws_;                 // Space screw of joint i in column i
+        std::vector<size_t> jointIndices_;
+        RigidTransform home_;              // End effector when every chain joint is zero
+
+    }; // class ScrewChain
+
+} // namespace RobotKin
+
+#endif
+
+
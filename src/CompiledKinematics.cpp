@@ -0,0 +1,358 @@
+/*
+ -------------------------------------------------------------------------------
+ CompiledKinematics.cpp
+ Robot Library Project
+
+ Version 1.0
+ -------------------------------------------------------------------------------
+ */
+
+
+
+//------------------------------------------------------------------------------
+// Includes
+//------------------------------------------------------------------------------
+#include "CompiledKinematics.h"
+#include "Robot.h"
+
+
+//------------------------------------------------------------------------------
+// Namespaces
+//------------------------------------------------------------------------------
+using namespace std;
+using namespace Eigen;
+using namespace RobotKin;
+
+
+// Number of configurations pushed through the tree at a time by the batched
+// forward kinematics, small enough to keep the working set in cache
+static const int BATCH_CHUNK = 32;
+
+// Batched counterpart of RobotKin::rotateColumns(): rotate rotation columns
+// i and j of every configuration by its own angle
+static void rotateColumnsBatch(Array<double, Dynamic, 12>& F, int i, int j, const ArrayXd& angle,
+                               ArrayXd& c, ArrayXd& s, Array<double, Dynamic, 12>& temp)
+{
+    c = angle.cos();
+    s = angle.sin();
+    temp.leftCols<3>() = F.middleCols<3>(3*i);
+    for(int row=0; row<3; row++)
+    {
+        F.col(row+3*i) = c*temp.col(row) + s*F.col(row+3*j);
+        F.col(row+3*j) = c*F.col(row+3*j) - s*temp.col(row);
+    }
+}
+
+static void toTransform(const Array<double, Dynamic, 12>& batch, int k, TRANSFORM& pose)
+{
+    pose.setIdentity();
+    for(int col=0; col<3; col++)
+        for(int row=0; row<3; row++)
+            pose.matrix()(row,col) = batch(k, row+3*col);
+    for(int row=0; row<3; row++)
+        pose.matrix()(row,3) = batch(k, 9+row);
+}
+
+
+//------------------------------------------------------------------------------
+// CompiledKinematics Lifecycle
+//------------------------------------------------------------------------------
+CompiledKinematics::CompiledKinematics()
+{
+
+}
+
+CompiledKinematics::CompiledKinematics(const Robot& robot)
+{
+    compile(robot);
+}
+
+CompiledKinematics::CompiledKinematics(const Linkage& linkage)
+{
+    compile(linkage);
+}
+
+void CompiledKinematics::clear()
+{
+    fixed_.resize(0);
+    axis_.resize(0);
+    jointType_.resize(0);
+    kernel_.resize(0);
+    frameType_.resize(0);
+    min_.resize(0);
+    max_.resize(0);
+    parent_.resize(0);
+    jointIndex_.resize(0);
+}
+
+void CompiledKinematics::compile(const Robot& robot)
+{
+    clear();
+
+    const vector<Linkage*>& linkages = robot.const_linkages();
+    jointFrame_.assign(robot.nJoints(), 0);
+    toolFrame_.assign(linkages.size(), 0);
+    linkageFrame_.assign(linkages.size(), 0);
+
+    // Robot::addLinkage() only accepts parents that already exist, so the
+    // linkage order is already topological
+    for(size_t l=0; l<linkages.size(); l++)
+    {
+        const Linkage* linkage = linkages[l];
+
+        int parent = -1;
+        if(linkage->hasParent)
+            parent = (int)toolFrame_[linkage->parentLinkage_->id()];
+
+        linkageFrame_[l] = fixed_.size();
+        addFrame(linkage->respectToFixed(), parent, LINKAGE);
+
+        parent = (int)linkageFrame_[l];
+        for(size_t j=0; j<linkage->nJoints(); j++)
+        {
+            const Joint& joint = linkage->const_joint(j);
+            jointFrame_[joint.id()] = fixed_.size();
+            addFrame(joint.respectToFixed(), parent, JOINT, joint.getJointType(),
+                     joint.getJointAxis(), (int)joint.id(), joint.min(), joint.max());
+            parent = (int)jointFrame_[joint.id()];
+        }
+
+        toolFrame_[l] = fixed_.size();
+        addFrame(linkage->const_tool().respectToFixed(), parent, TOOL);
+    }
+}
+
+void CompiledKinematics::compile(const Linkage& linkage)
+{
+    clear();
+
+    jointFrame_.assign(linkage.nJoints(), 0);
+    toolFrame_.assign(1, 0);
+    linkageFrame_.assign(1, 0);
+
+    addFrame(TRANSFORM::Identity(), -1, LINKAGE);
+
+    int parent = 0;
+    for(size_t j=0; j<linkage.nJoints(); j++)
+    {
+        const Joint& joint = linkage.const_joint(j);
+        jointFrame_[j] = fixed_.size();
+        addFrame(joint.respectToFixed(), parent, JOINT, joint.getJointType(),
+                 joint.getJointAxis(), (int)j, joint.min(), joint.max());
+        parent = (int)jointFrame_[j];
+    }
+
+    toolFrame_[0] = fixed_.size();
+    addFrame(linkage.const_tool().respectToFixed(), parent, TOOL);
+}
+
+void CompiledKinematics::addFrame(const TRANSFORM& fixed, int parent, FrameType frameType,
+                                  JointType jointType, const AXIS& axis,
+                                  int jointIndex, double minValue, double maxValue)
+{
+    fixed_.push_back(RigidTransform(fixed));
+    axis_.push_back(axis);
+    jointType_.push_back(jointType);
+    kernel_.push_back(selectJointKernel(jointType, axis));
+    frameType_.push_back(frameType);
+    min_.push_back(minValue);
+    max_.push_back(maxValue);
+    parent_.push_back(parent);
+    jointIndex_.push_back(jointIndex);
+}
+
+
+//------------------------------------------------------------------------------
+// CompiledKinematics Public Member Functions
+//------------------------------------------------------------------------------
+size_t CompiledKinematics::nFrames() const { return fixed_.size(); }
+size_t CompiledKinematics::nJoints() const { return jointFrame_.size(); }
+size_t CompiledKinematics::nLinkages() const { return linkageFrame_.size(); }
+
+size_t CompiledKinematics::jointFrame(size_t jointIndex) const { return jointFrame_[jointIndex]; }
+size_t CompiledKinematics::toolFrame(size_t linkageIndex) const { return toolFrame_[linkageIndex]; }
+size_t CompiledKinematics::linkageFrame(size_t linkageIndex) const { return linkageFrame_[linkageIndex]; }
+
+int CompiledKinematics::parent(size_t frame) const { return parent_[frame]; }
+FrameType CompiledKinematics::frameType(size_t frame) const { return frameType_[frame]; }
+JointType CompiledKinematics::jointType(size_t frame) const { return jointType_[frame]; }
+JointKernel CompiledKinematics::kernel(size_t frame) const { return kernel_[frame]; }
+int CompiledKinematics::jointIndex(size_t frame) const { return jointIndex_[frame]; }
+TRANSFORM CompiledKinematics::fixed(size_t frame) const { return fixed_[frame].toIsometry(); }
+const AXIS& CompiledKinematics::axis(size_t frame) const { return axis_[frame]; }
+double CompiledKinematics::min(size_t frame) const { return min_[frame]; }
+double CompiledKinematics::max(size_t frame) const { return max_[frame]; }
+
+void CompiledKinematics::forwardKinematics(const VectorXd& q, vector<TRANSFORM>& frames) const
+{
+    size_t n = fixed_.size();
+    frames.resize(n);
+
+    if((size_t)q.size() != nJoints())
+    {
+        cerr << "Invalid number of joint values: " << q.size()
+             << "\n\t This should be equal to " << nJoints() << endl;
+        return;
+    }
+
+    for(size_t i=0; i<n; i++)
+    {
+        if(parent_[i] < 0)
+            frames[i] = fixed_[i].toIsometry();
+        else
+            frames[i] = frames[parent_[i]] * fixed_[i];
+
+        if(jointIndex_[i] >= 0)
+            applyJointKernel(kernel_[i], axis_[i], q[jointIndex_[i]], frames[i]);
+    }
+}
+
+void CompiledKinematics::batchForwardKinematics(const JointBatch& Q, vector<TRANSFORM>& frames) const
+{
+    size_t n = fixed_.size();
+    frames.resize(n*Q.cols());
+
+    if((size_t)Q.rows() != nJoints())
+    {
+        cerr << "Invalid number of joint values: " << Q.rows()
+             << "\n\t This should be equal to " << nJoints() << endl;
+        return;
+    }
+
+    vector<bool> needed(n, true);
+    vector<FrameBatch> batch(n);
+    for(int start=0; start<Q.cols(); start+=BATCH_CHUNK)
+    {
+        int count = std::min<int>(BATCH_CHUNK, Q.cols()-start);
+        batchChunk(Q, start, count, needed, batch);
+
+        for(size_t f=0; f<n; f++)
+            for(int k=0; k<count; k++)
+                toTransform(batch[f], k, frames[(start+k)*n + f]);
+    }
+}
+
+void CompiledKinematics::batchToolPoses(const JointBatch& Q, size_t linkageIndex, vector<TRANSFORM>& poses) const
+{
+    poses.resize(Q.cols());
+
+    if((size_t)Q.rows() != nJoints())
+    {
+        cerr << "Invalid number of joint values: " << Q.rows()
+             << "\n\t This should be equal to " << nJoints() << endl;
+        return;
+    }
+
+    if(linkageIndex >= nLinkages())
+    {
+        cerr << "Invalid linkage index: " << linkageIndex << endl;
+        return;
+    }
+
+    // Only the path from the robot base to the tool matters
+    size_t tool = toolFrame_[linkageIndex];
+    vector<bool> needed(fixed_.size(), false);
+    for(int f=(int)tool; f >= 0; f = parent_[f])
+        needed[f] = true;
+
+    vector<FrameBatch> batch(fixed_.size());
+    for(int start=0; start<Q.cols(); start+=BATCH_CHUNK)
+    {
+        int count = std::min<int>(BATCH_CHUNK, Q.cols()-start);
+        batchChunk(Q, start, count, needed, batch);
+
+        for(int k=0; k<count; k++)
+            toTransform(batch[tool], k, poses[start+k]);
+    }
+}
+
+void CompiledKinematics::batchChunk(const JointBatch& Q, int start, int count,
+                                    const vector<bool>& needed, vector<FrameBatch>& batch) const
+{
+    ArrayXd c(count), s(count), t(count), q(count);
+    FrameBatch R(count, 12);
+
+    for(size_t i=0; i<fixed_.size(); i++)
+    {
+        if(!needed[i])
+            continue;
+
+        FrameBatch& F = batch[i];
+        F.resize(count, 12);
+
+        const Matrix3d& Rf = fixed_[i].rotation();
+        const Vector3d& pf = fixed_[i].translation();
+
+        // Compose the parent frame with the fixed transform
+        if(parent_[i] < 0)
+        {
+            for(int col=0; col<3; col++)
+                for(int row=0; row<3; row++)
+                    F.col(row+3*col).setConstant(Rf(row,col));
+            for(int row=0; row<3; row++)
+                F.col(9+row).setConstant(pf[row]);
+        }
+        else
+        {
+            const FrameBatch& P = batch[parent_[i]];
+            for(int col=0; col<3; col++)
+                for(int row=0; row<3; row++)
+                    F.col(row+3*col) = P.col(row)*Rf(0,col) + P.col(row+3)*Rf(1,col)
+                                     + P.col(row+6)*Rf(2,col);
+            for(int row=0; row<3; row++)
+                F.col(9+row) = P.col(row)*pf[0] + P.col(row+3)*pf[1]
+                             + P.col(row+6)*pf[2] + P.col(9+row);
+        }
+
+        if(kernel_[i] == KERNEL_FIXED)
+            continue;
+
+        q = Q.row(jointIndex_[i]).segment(start, count).transpose().array();
+        const AXIS& a = axis_[i];
+
+        switch(kernel_[i])
+        {
+        case KERNEL_REVOLUTE_X: q *= a[0]; rotateColumnsBatch(F, 1, 2, q, c, s, R); break;
+        case KERNEL_REVOLUTE_Y: q *= a[1]; rotateColumnsBatch(F, 2, 0, q, c, s, R); break;
+        case KERNEL_REVOLUTE_Z: q *= a[2]; rotateColumnsBatch(F, 0, 1, q, c, s, R); break;
+
+        case KERNEL_PRISMATIC_X:
+        case KERNEL_PRISMATIC_Y:
+        case KERNEL_PRISMATIC_Z:
+        {
+            int k = kernel_[i] - KERNEL_PRISMATIC_X;
+            for(int row=0; row<3; row++)
+                F.col(9+row) += F.col(row+3*k)*(a[k]*q);
+            break;
+        }
+
+        case KERNEL_PRISMATIC:
+            for(int row=0; row<3; row++)
+                F.col(9+row) += (F.col(row)*a[0] + F.col(row+3)*a[1] + F.col(row+6)*a[2])*q;
+            break;
+
+        default:
+        {
+            // Rodrigues' formula, one rotation per configuration:
+            // Rj = c*I + s*[a]x + (1-c)*a*a^T
+            c = q.cos();
+            s = q.sin();
+            t = 1 - c;
+
+            Matrix3d K;
+            K <<     0, -a[2],  a[1],
+                  a[2],     0, -a[0],
+                 -a[1],  a[0],     0;
+
+            R.leftCols<9>() = F.leftCols<9>();
+            for(int col=0; col<3; col++)
+                for(int row=0; row<3; row++)
+                    F.col(row+3*col) = R.col(row)*(t*(a[0]*a[col]) + s*K(0,col))
+                                     + R.col(row+3)*(t*(a[1]*a[col]) + s*K(1,col))
+                                     + R.col(row+6)*(t*(a[2]*a[col]) + s*K(2,col))
+                                     + R.col(row+3*col)*c;
+            break;
+        }
+        }
+    }
+}
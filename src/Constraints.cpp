@@ -35,10 +35,9 @@ Constraints::Constraints()
 
 
 
-Constraints &Constraints::Defaults()
+Constraints Constraints::Defaults()
 {
-    Constraints* constraints = new Constraints;
-    return *constraints;
+    return Constraints();
 }
 
 void Constraints::restingValues(VectorXd newRestingValues)
@@ -58,22 +57,58 @@ bool Constraints::nullComplete()
         return nullComplete_;
 }
 
-VectorXd Constraints::nullSpaceTask(Robot& robot, const MatrixXd& J, const std::vector<size_t> &indices,
+VectorXd Constraints::nullSpaceTask(KinematicState& state, const MatrixXd& J, const std::vector<size_t> &indices,
                                     const VectorXd& values)
 {
-    VectorXd nullTask = values;
-    nullTask.setZero();
-    nullComplete_ = true;
-    return nullTask;
+    if(state.robot() != NULL)
+        return nullSpaceTask(*state.robot(), J, indices, values);
+
+    return defaultNullSpaceTask(values);
 }
 
-void Constraints::errorClamp(Robot &robot, const std::vector<size_t> &indices, SCREW &error)
+VectorXd Constraints::nullSpaceTask(Robot& /*robot*/, const MatrixXd& /*J*/, const std::vector<size_t>& /*indices*/,
+                                    const VectorXd& values)
 {
+    return defaultNullSpaceTask(values);
+}
 
+void Constraints::errorClamp(KinematicState &state, const std::vector<size_t> &indices, SCREW &error)
+{
+    if(state.robot() != NULL)
+        errorClamp(*state.robot(), indices, error);
+}
+
+void Constraints::errorClamp(Robot& /*robot*/, const std::vector<size_t>& /*indices*/, SCREW& /*error*/)
+{
+
+}
+
+void Constraints::iterativeJacobianSeed(KinematicState& state, size_t attemptNumber,
+                                        const std::vector<size_t> &indices, Eigen::VectorXd &values)
+{
+    if(state.robot() != NULL)
+        iterativeJacobianSeed(*state.robot(), attemptNumber, indices, values);
+    else
+        defaultIterativeJacobianSeed(state, attemptNumber, indices, values);
 }
 
 void Constraints::iterativeJacobianSeed(Robot& robot, size_t attemptNumber,
                                         const std::vector<size_t> &indices, Eigen::VectorXd &values)
+{
+    RobotKinematicState state(robot);
+    defaultIterativeJacobianSeed(state, attemptNumber, indices, values);
+}
+
+VectorXd Constraints::defaultNullSpaceTask(const VectorXd& values)
+{
+    VectorXd nullTask = values;
+    nullTask.setZero();
+    nullComplete_ = true;
+    return nullTask;
+}
+
+void Constraints::defaultIterativeJacobianSeed(KinematicState& state, size_t attemptNumber,
+                                               const std::vector<size_t> &indices, Eigen::VectorXd &values)
 {
     if( attemptNumber == 0 )
     {
@@ -87,7 +122,7 @@ void Constraints::iterativeJacobianSeed(Robot& robot, size_t attemptNumber,
     else if( attemptNumber == 2 )
     {
         wrapToJointLimits = false;
-        robot.imposeLimits = false;
+        state.setImposeLimits(false);
         for(int i=0; i<values.size(); i++)
             values(i) = 0;
     }
@@ -97,13 +132,7 @@ void Constraints::iterativeJacobianSeed(Robot& robot, size_t attemptNumber,
         int randVal = rand();
         for(int i=0; i<values.size(); i++)
             values(i) = ((double)(randVal%resolution))/((double)resolution-1)
-                    *(robot.joint(indices[i]).max() - robot.joint(indices[i]).min())
-                    + robot.joint(indices[i]).min();
+                    *(state.max(indices[i]) - state.min(indices[i]))
+                    + state.min(indices[i]);
     }
 }
-
-
-
-
-
-
@@ -16,6 +16,8 @@
 //------------------------------------------------------------------------------
 #include "Frame.h"
 #include "Robot.h"
+#include "RigidTransform.h"
+#include "RelativeTransforms.h"
 
 
 
@@ -51,6 +53,21 @@ string RobotKin::JointType_to_string(JointType type)
         return "Unknown Joint Type";
 }
 
+JointKernel RobotKin::selectJointKernel(JointType type, const AXIS& axis)
+{
+    int unitAxis = -1;
+    for(int k=0; k<3; k++)
+        if(fabs(axis[k]) == 1 && axis[(k+1)%3] == 0 && axis[(k+2)%3] == 0)
+            unitAxis = k;
+
+    if(type == REVOLUTE)
+        return unitAxis < 0 ? KERNEL_REVOLUTE : (JointKernel)(KERNEL_REVOLUTE_X + unitAxis);
+    else if(type == PRISMATIC)
+        return unitAxis < 0 ? KERNEL_PRISMATIC : (JointKernel)(KERNEL_PRISMATIC_X + unitAxis);
+
+    return KERNEL_FIXED;
+}
+
 
 
 //------------------------------------------------------------------------------
@@ -58,15 +75,16 @@ string RobotKin::JointType_to_string(JointType type)
 //------------------------------------------------------------------------------
 // Constructors
 Frame::Frame(TRANSFORM respectToFixed, string name, size_t id, FrameType frameType)
-    : name_(name),
+    : gravity_constant(9.81),
+      name_(name),
       id_(id),
       frameType_(frameType),
       respectToFixed_(respectToFixed),
-      linkage_(NULL),
       robot_(NULL),
+      linkage_(NULL),
       hasRobot(false),
       hasLinkage(false),
-      gravity_constant(9.81)
+      worldCacheValid_(false)
 {
     
 }
@@ -91,13 +109,13 @@ void Frame::name(string newName)
     {
         if(frameType()==LINKAGE)
         {
-            robot_->linkageNameToIndex_[newName] = robot_->linkageNameToIndex_[name_];
+            robot_->linkageNameToIndex_.insert(newName, robot_->linkageNameToIndex_.find(name_));
             robot_->linkageNameToIndex_.erase(name_);
         }
 
         if(frameType()==JOINT)
         {
-            robot_->jointNameToIndex_[newName] = robot_->jointNameToIndex_[name_];
+            robot_->jointNameToIndex_.insert(newName, robot_->jointNameToIndex_.find(name_));
             robot_->jointNameToIndex_.erase(name_);
         }
     }
@@ -106,7 +124,7 @@ void Frame::name(string newName)
     {
         if(frameType()==JOINT)
         {
-            linkage_->jointNameToIndex_[newName] = linkage_->jointNameToIndex_[name_];
+            linkage_->jointNameToIndex_.insert(newName, linkage_->jointNameToIndex_.find(name_));
             linkage_->jointNameToIndex_.erase(name_);
         }
     }
@@ -121,7 +139,7 @@ string Frame::frameTypeString() const
 
 TRANSFORM Frame::respectTo(const Frame* aFrame) const
 {
-    return aFrame->respectToWorld().inverse() * respectToWorld();
+    return RelativeTransforms::respectTo(*this, *aFrame);
 }
 
 TRANSFORM Frame::withRespectTo(const Frame &frame) const { return respectTo(&frame); }
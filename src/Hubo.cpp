@@ -45,6 +45,8 @@ Hubo::~Hubo()
     
 }
 
+Hubo* Hubo::clone() const { return new Hubo(*this); }
+
 
 //------------------------------------------------------------------------------
 // Hubo Public Member Functions
@@ -584,10 +586,10 @@ void Hubo::armFK(TRANSFORM& B, const SCREW& q, size_t side)
     } else {
         index = linkageIndex("LEFT_ARM");
     }
-    VectorXd q0 = linkage(index).values();
+    snapshot(fkSnapshot, index);
     linkage(index).values(q);
-    B = linkage(index).tool().respectToLinkage();
-    linkage(index).values(q0);
+    B = linkage(index).const_tool().respectToLinkage();
+    restore(fkSnapshot);
 }
 
 void Hubo::legFK(TRANSFORM& B, const SCREW& q, size_t side)
@@ -598,10 +600,10 @@ void Hubo::legFK(TRANSFORM& B, const SCREW& q, size_t side)
     } else {
         index = linkageIndex("LEFT_LEG");
     }
-    VectorXd q0 = linkage(index).values();
+    snapshot(fkSnapshot, index);
     linkage(index).values(q);
-    B = linkage(index).tool().respectToLinkage();
-    linkage(index).values(q0);
+    B = linkage(index).const_tool().respectToLinkage();
+    restore(fkSnapshot);
 }
 
 bool Hubo::armAnalyticalIK(VectorXd& q, const TRANSFORM& B, const SCREW& qPrev, size_t side)
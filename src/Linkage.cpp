@@ -16,6 +16,7 @@
 //------------------------------------------------------------------------------
 #include "Linkage.h"
 #include "Robot.h"
+#include "CompiledKinematics.h"
 
 
 //------------------------------------------------------------------------------
@@ -26,6 +27,15 @@ using namespace Eigen;
 using namespace RobotKin;
 
 
+// Pose of frames that are not attached to anything. Reading it never
+// writes to the frame, which keeps the const sentinels untouched.
+static const TRANSFORM& identityTransform()
+{
+    static const TRANSFORM identity = TRANSFORM::Identity();
+    return identity;
+}
+
+
 //------------------------------------------------------------------------------
 // Linkage Nested Classes
 //------------------------------------------------------------------------------
@@ -42,22 +52,28 @@ Joint& Joint::operator =( const Joint& joint )
 
     jointType_ = joint.jointType_;
     jointAxis_ = joint.jointAxis_;
+    kernel_ = joint.kernel_;
     min_ = joint.min_;
     max_ = joint.max_;
 
     value(joint.value_);
+    if( hasLinkage )
+        linkage_->markDirty(localID_);
 
     link = joint.link;
+
+    return *this;
 }
 
 Joint::Joint(const Joint &joint)
     : Frame::Frame(joint.respectToFixed_, joint.name(), joint.id(), JOINT),
-      respectToFixedTransformed_(joint.respectToFixedTransformed_),
+      link(joint.link),
       jointType_(joint.jointType_),
-      jointAxis_(joint.jointAxis_),
       min_(joint.min_),
       max_(joint.max_),
-      link(joint.link)
+      jointAxis_(joint.jointAxis_),
+      kernel_(joint.kernel_),
+      respectToFixedTransformed_(joint.respectToFixedTransformed_)
 {
     value(joint.value_);
 }
@@ -69,12 +85,12 @@ Joint::Joint(TRANSFORM respectToFixed,
                       AXIS axis,
                       double minValue, double maxValue)
             : Frame::Frame(respectToFixed, name, id, JOINT),
-              respectToFixedTransformed_(respectToFixed),
-              respectToLinkage_(respectToFixed),
+              value_(0),
               jointType_(jointType),
               min_(minValue),
               max_(maxValue),
-              value_(0)
+              respectToFixedTransformed_(respectToFixed),
+              respectToLinkage_(respectToFixed)
 {
     setJointAxis(axis);
     value(value_);
@@ -139,6 +155,31 @@ void Link::setInertiaTensor(Eigen::Matrix3d newInertiaTensor)
 }
 
 
+void Link::merge(const Link& other, const TRANSFORM& offset)
+{
+    if(!other.massProvided || other.mass_ <= 0)
+        return;
+
+    double m1 = massProvided ? mass_ : 0;
+    double m2 = other.mass_;
+    TRANSLATION c1 = com_;
+    TRANSLATION c2 = offset*other.com_;
+    TRANSLATION c = (m1*c1 + m2*c2)/(m1+m2);
+
+    // Parallel axis theorem about the combined center of mass
+    TRANSLATION d1 = c1 - c, d2 = c2 - c;
+    Matrix3d I1 = tensorProvided ? tensor_ : Matrix3d::Zero();
+    Matrix3d I2 = other.tensorProvided ? Matrix3d(offset.rotation()*other.tensor_*offset.rotation().transpose())
+                                       : Matrix3d::Zero();
+    tensor_ = I1 + m1*(d1.dot(d1)*Matrix3d::Identity() - d1*d1.transpose())
+            + I2 + m2*(d2.dot(d2)*Matrix3d::Identity() - d2*d2.transpose());
+    tensorProvided = tensorProvided || other.tensorProvided;
+
+    mass_ = m1 + m2;
+    com_ = c;
+    massProvided = true;
+}
+
 bool Link::hasMass() const { return massProvided; }
 bool Link::hasTensor() const { return tensorProvided; }
 
@@ -154,15 +195,25 @@ void Joint::setJointAxis(AXIS axis)
 {
     jointAxis_ = axis;
     jointAxis_.normalize();
+    kernel_ = selectJointKernel(jointType_, jointAxis_);
+
+    if( hasLinkage )
+    {
+        linkage_->markDirty(localID_);
+        linkage_->geometryChanged();
+    }
 }
 
-AXIS Joint::getJointAxis() { return jointAxis_; }
+AXIS Joint::getJointAxis() const { return jointAxis_; }
+
+JointKernel Joint::getJointKernel() const { return kernel_; }
 
 // Joint Methods
 double Joint::value() const { return value_; }
-rk_result_t Joint::value(double newValue, bool update)
+rk_result_t Joint::value(double newValue, bool /*update*/)
 {
     rk_result_t result = RK_SOLVED;
+    double previous = hasLinkage ? value_ : newValue;
 
     if(newValue < min_)
     {
@@ -183,25 +234,27 @@ rk_result_t Joint::value(double newValue, bool update)
         if(!robot_->imposeLimits)
             value_ = newValue;
 
-    if (jointType_ == REVOLUTE) {
-        respectToFixedTransformed_ = respectToFixed_ * Eigen::AngleAxisd(value_, jointAxis_);
-    } else if(jointType_ == PRISMATIC){
-        respectToFixedTransformed_ = respectToFixed_ * Eigen::Translation3d(value_*jointAxis_);
-    } else {
-        respectToFixedTransformed_ = respectToFixed_;
-    }
-    
+    // The transforms are only marked dirty here; they get recomputed once
+    // when a frame of this linkage (or of a descendant) is next queried.
+    // The update argument is kept for compatibility and no longer matters.
+    // Rewriting the current value, or moving an anchor, changes no frame.
     if( hasLinkage )
-        linkage_->needsUpdate_ = true;
-
-    // TODO: Decide if it is efficient to have this here
-    if ( hasLinkage && update )
-        linkage_->updateFrames();
+    {
+        if( value_ != previous && jointType_ != ANCHOR )
+            linkage_->markDirty(localID_);
+    }
+    else
+        updateTransformed();
 
     return result;
 }
 
-JointType Joint::getJointType(){ return jointType_; }
+void Joint::updateTransformed() const
+{
+    respectToFixedTransformed_ = respectToFixedTransformed(value_);
+}
+
+JointType Joint::getJointType() const { return jointType_; }
 
 double Joint::min() const { return min_; }
 void Joint::min(double newMin)
@@ -212,7 +265,7 @@ void Joint::min(double newMin)
         max_ = min_;
 
     if(value_ < min_)
-        value_ = min_;
+        value(min_);
 }
 
 double Joint::max() const { return max_; }
@@ -224,7 +277,7 @@ void Joint::max(double newMax)
         min_ = max_;
 
     if(value_ > max_)
-        value_ = max_;
+        value(max_);
 }
 
 
@@ -238,33 +291,78 @@ const TRANSFORM& Joint::respectToFixed() const { return respectToFixed_; }
 void Joint::respectToFixed(TRANSFORM aCoordinate)
 {
     respectToFixed_ = aCoordinate;
-    value(value_);
+    if( hasLinkage )
+    {
+        linkage_->markDirty(localID_);
+        linkage_->geometryChanged();
+    }
+    else
+        updateTransformed();
 }
 
 const TRANSFORM& Joint::respectToFixedTransformed() const
 {
+    if(hasLinkage && linkage_->needsUpdate_)
+        linkage_->updateFrames();
     return respectToFixedTransformed_;
 }
 
+TRANSFORM Joint::respectToFixedTransformed(double atValue) const
+{
+    TRANSFORM transformed = respectToFixed_;
+    applyJointKernel(kernel_, jointAxis_, atValue, transformed);
+    return transformed;
+}
+
 const TRANSFORM& Joint::respectToLinkage() const
 {
+    if(hasLinkage && linkage_->needsUpdate_)
+        linkage_->updateFrames();
     return respectToLinkage_;
 }
 
 TRANSFORM Joint::respectToRobot() const
 {
     if(hasLinkage)
-        return linkage_->respectToRobot_ * respectToLinkage_;
+        return linkage_->respectToRobot() * respectToLinkage();
     else
         return TRANSFORM::Identity();
 }
 
-TRANSFORM Joint::respectToWorld() const
+const TRANSFORM& Joint::respectToWorld() const
 {
     if(hasLinkage)
-        return linkage_->respectToWorld() * respectToLinkage_;
+    {
+        // Bring the linkage up to date first; that clears the cache if
+        // this frame moved
+        const TRANSFORM& base = linkage_->respectToWorld();
+        const TRANSFORM& local = respectToLinkage();
+        if(!worldCacheValid_)
+        {
+            respectToWorldCache_ = base * local;
+            worldCacheValid_ = true;
+        }
+    }
     else
-        return TRANSFORM::Identity();
+        return identityTransform();
+
+    return respectToWorldCache_;
+}
+
+Joint& Joint::Invalid()
+{
+    static Joint invalidJoint;
+    invalidJoint = Joint();
+    invalidJoint.name_ = "invalid";
+    return invalidJoint;
+}
+
+const Joint& Joint::ConstInvalid()
+{
+    // Without a linkage none of its frames are computed lazily, so reading
+    // it never writes to it
+    static const Joint invalidJoint(TRANSFORM::Identity(), "invalid");
+    return invalidJoint;
 }
 
 Linkage& Joint::linkage()
@@ -273,9 +371,7 @@ Linkage& Joint::linkage()
         return *linkage_;
 
     cerr << "Joint " << name() << " does not have a linkage yet!" << endl;
-    Linkage* invalidLinkage = new Linkage;
-    invalidLinkage->name("invalid");
-    return *invalidLinkage;
+    return Linkage::Invalid();
 }
 
 Robot& Joint::robot()
@@ -284,9 +380,7 @@ Robot& Joint::robot()
         return *robot_;
 
     cerr << "Joint " << name() << " does not have a robot yet!" << endl;
-    Robot* invalidRobot = new Robot;
-    invalidRobot->name("invalid");
-    return *invalidRobot;
+    return Robot::Invalid();
 }
 
 void Link::printInfo() const
@@ -327,6 +421,8 @@ Tool& Tool::operator =(const Tool& tool)
     frameType_ = tool.frameType_;
 
     massProperties = tool.massProperties;
+
+    return *this;
 }
 
 
@@ -357,11 +453,18 @@ void Tool::respectToFixed(TRANSFORM aCoordinate)
 {
     respectToFixed_ = aCoordinate;
     if(hasLinkage)
-        linkage_->updateFrames();
+    {
+        linkage_->markDirty(linkage_->nJoints());
+        linkage_->geometryChanged();
+    }
+    else
+        respectToLinkage_ = respectToFixed_;
 }
 
 const TRANSFORM& Tool::respectToLinkage() const
 {
+    if(hasLinkage && linkage_->needsUpdate_)
+        linkage_->updateFrames();
     return respectToLinkage_;
 }
 
@@ -369,17 +472,25 @@ const TRANSFORM& Tool::respectToLinkage() const
 TRANSFORM Tool::respectToRobot() const
 {
     if(hasLinkage)
-        return linkage_->respectToRobot_ * respectToLinkage_;
+        return linkage_->respectToRobot() * respectToLinkage();
     else
         return respectToLinkage_;
 }
 
-TRANSFORM Tool::respectToWorld() const
+const TRANSFORM& Tool::respectToWorld() const
 {
-    if(hasLinkage)
-        return linkage_->respectToWorld() * respectToLinkage_;
-    else
+    if(!hasLinkage)
         return respectToLinkage_;
+
+    const TRANSFORM& base = linkage_->respectToWorld();
+    const TRANSFORM& local = respectToLinkage();
+    if(!worldCacheValid_)
+    {
+        respectToWorldCache_ = base * local;
+        worldCacheValid_ = true;
+    }
+
+    return respectToWorldCache_;
 }
 
 const Linkage* Tool::parentLinkage() const
@@ -506,9 +617,7 @@ Joint& Joint::parentJoint()
             return linkage().parentLinkage().joint(linkage().parentLinkage().nJoints()-1);
     }
 
-    Joint* invalidJoint = new Joint;
-    invalidJoint->name("invalid");
-    return *invalidJoint;
+    return Joint::Invalid();
 }
 
 size_t Linkage::getRobotID()
@@ -583,12 +692,21 @@ Linkage& Linkage::operator =( const Linkage& linkage )
     id_ = linkage.id_;
     frameType_ = linkage.frameType_;
     
+    // Joints in the arena of a robot are released with the robot
+    if(ownsJoints_)
+        for(size_t i=0; i<joints_.size(); i++)
+            delete joints_[i];
     joints_.resize(0);
+    jointNameToIndex_.clear();
     for(size_t i=0; i<linkage.joints_.size(); i++)
         addJoint(*(linkage.joints_[i]));
     setTool(linkage.tool_);
     
-    updateFrames();
+    revision_++;
+    markDirty();
+    markBaseDirty();
+
+    return *this;
 }
 
 Linkage::Linkage(const Linkage &linkage)
@@ -596,24 +714,34 @@ Linkage::Linkage(const Linkage &linkage)
                    linkage.id_, linkage.frameType_),
       respectToRobot_(linkage.respectToRobot_),
       tool_(linkage.tool_),
-      initializing_(false),
       hasParent(false),
-      hasChildren(false)
+      hasChildren(false),
+      initializing_(false),
+      needsUpdate_(true),
+      needsBaseUpdate_(true),
+      firstDirtyJoint_(0),
+      revision_(0),
+      depth_(0),
+      ownsJoints_(true)
 {
     for(size_t i=0; i<linkage.joints_.size(); i++)
         addJoint(*(linkage.joints_[i]));
 
     setTool(linkage.tool_);
-    
-    updateFrames();
 }
 
 Linkage::Linkage()
     : Frame::Frame(TRANSFORM::Identity(), "", 0, LINKAGE),
       respectToRobot_(TRANSFORM::Identity()),
-      initializing_(false),
       hasParent(false),
-      hasChildren(false)
+      hasChildren(false),
+      initializing_(false),
+      needsUpdate_(true),
+      needsBaseUpdate_(true),
+      firstDirtyJoint_(0),
+      revision_(0),
+      depth_(0),
+      ownsJoints_(true)
 {
     analyticalIK = Linkage::defaultAnalyticalIK;
 }
@@ -621,9 +749,15 @@ Linkage::Linkage()
 Linkage::Linkage(TRANSFORM respectToFixed, string name, size_t id)
     : Frame::Frame(respectToFixed, name, id, LINKAGE),
       respectToRobot_(TRANSFORM::Identity()),
-      initializing_(false),
       hasParent(false),
-      hasChildren(false)
+      hasChildren(false),
+      initializing_(false),
+      needsUpdate_(true),
+      needsBaseUpdate_(true),
+      firstDirtyJoint_(0),
+      revision_(0),
+      depth_(0),
+      ownsJoints_(true)
 {
     analyticalIK = Linkage::defaultAnalyticalIK;
 }
@@ -632,9 +766,15 @@ Linkage::Linkage(TRANSFORM respectToFixed, string name, size_t id)
 Linkage::Linkage(TRANSFORM respectToFixed, string name, size_t id, Joint joint, Tool tool)
     : Frame::Frame(respectToFixed, name, id, LINKAGE),
       respectToRobot_(respectToFixed),
-      initializing_(false),
       hasParent(false),
-      hasChildren(false)
+      hasChildren(false),
+      initializing_(false),
+      needsUpdate_(true),
+      needsBaseUpdate_(true),
+      firstDirtyJoint_(0),
+      revision_(0),
+      depth_(0),
+      ownsJoints_(true)
 {
     analyticalIK = Linkage::defaultAnalyticalIK;
     vector<Joint> joints(1);
@@ -645,9 +785,15 @@ Linkage::Linkage(TRANSFORM respectToFixed, string name, size_t id, Joint joint,
 Linkage::Linkage(TRANSFORM respectToFixed, string name, size_t id, vector<Joint> joints, Tool tool)
     : Frame::Frame(respectToFixed, name, id, LINKAGE),
       respectToRobot_(respectToFixed),
-      initializing_(false),
       hasParent(false),
-      hasChildren(false)
+      hasChildren(false),
+      initializing_(false),
+      needsUpdate_(true),
+      needsBaseUpdate_(true),
+      firstDirtyJoint_(0),
+      revision_(0),
+      depth_(0),
+      ownsJoints_(true)
 {
     analyticalIK = Linkage::defaultAnalyticalIK;
     initialize(joints, tool);
@@ -656,7 +802,9 @@ Linkage::Linkage(TRANSFORM respectToFixed, string name, size_t id, vector<Joint>
 // Destructor
 Linkage::~Linkage()
 {
-    
+    if(ownsJoints_)
+        for(size_t i=0; i<joints_.size(); i++)
+            delete joints_[i];
 }
 
 //------------------------------------------------------------------------------
@@ -673,6 +821,33 @@ const Linkage& Linkage::operator=(const VectorXd& someValues)
 // Linkage Public Member Functions
 //--------------------------------------------------------------------------
 
+Linkage& Linkage::Invalid()
+{
+    static Linkage invalidLinkage;
+    invalidLinkage = Linkage();
+    invalidLinkage.name_ = "invalid";
+    return invalidLinkage;
+}
+
+// Linkage without joints whose frames are brought up to date when it is
+// built, so reading it afterwards never writes to it
+class ConstInvalidLinkage : public Linkage
+{
+public:
+    ConstInvalidLinkage()
+        : Linkage(TRANSFORM::Identity(), "invalid", 0, vector<Joint>(), Tool::Identity())
+    {
+        respectToRobot();
+        const_tool().respectToWorld();
+    }
+};
+
+const Linkage& Linkage::ConstInvalid()
+{
+    static const ConstInvalidLinkage invalidLinkage;
+    return invalidLinkage;
+}
+
 Linkage &Linkage::parentLinkage()
 {
     if(hasParent)
@@ -680,9 +855,7 @@ Linkage &Linkage::parentLinkage()
 
     cerr << "You requested the parent of Linkage " << name()
          << ", but it does not have a parent!" << endl;
-    Linkage* invalidLinkage = new Linkage;
-    invalidLinkage->name("invalid");
-    return *invalidLinkage;
+    return Linkage::Invalid();
 }
 
 size_t Linkage::nChildren() const { return childLinkages_.size(); }
@@ -690,13 +863,12 @@ size_t Linkage::nChildren() const { return childLinkages_.size(); }
 rk_result_t Linkage::jointNamesToIndices(const vector<string> &jointNames, vector<size_t> &jointIndices)
 {
     jointIndices.resize(jointNames.size());
-    map<string,size_t>::iterator j;
     for(int i=0; i<jointNames.size(); i++)
     {
-        j = jointNameToIndex_.find(jointNames[i]);
-        if( j == jointNameToIndex_.end() )
+        size_t j = jointNameToIndex_.find(jointNames[i]);
+        if( j == NameTable::npos )
             return RK_INVALID_JOINT;
-        jointIndices[i] = j->second;
+        jointIndices[i] = j;
     }
 
     return RK_SOLVED;
@@ -704,10 +876,9 @@ rk_result_t Linkage::jointNamesToIndices(const vector<string> &jointNames, vecto
 
 size_t Linkage::jointNameToIndex(string jointName)
 {
-    map<string,size_t>::iterator j;
-    j = jointNameToIndex_.find(jointName);
-    if( j != jointNameToIndex_.end() )
-        return j->second;
+    size_t j = jointNameToIndex_.find(jointName);
+    if( j != NameTable::npos )
+        return j;
     else
         // TODO: Decide if this is a good idea
         return nJoints();
@@ -730,20 +901,16 @@ Joint& Linkage::joint(size_t jointIndex)
         return *joints_[jointIndex];
 
     cerr << "Invalid joint index: (" << jointIndex << ")" << endl;
-    Joint* invalidJoint = new Joint;
-    invalidJoint->name("invalid");
-    return *invalidJoint;
+    return Joint::Invalid();
 }
 Joint& Linkage::joint(string jointName)
 {
-    map<string,size_t>::const_iterator j = jointNameToIndex_.find(jointName);
-    if( j != jointNameToIndex_.end() )
-        return *joints_.at(j->second);
+    size_t j = jointNameToIndex_.find(jointName);
+    if( j != NameTable::npos )
+        return *joints_.at(j);
 
     cerr << "Invalid joint name: (" << jointName << ")" << endl;
-    Joint* invalidJoint = new Joint;
-    invalidJoint->name("invalid");
-    return *invalidJoint;
+    return Joint::Invalid();
 }
 
 Linkage& Linkage::childLinkage(size_t childIndex)
@@ -753,9 +920,7 @@ Linkage& Linkage::childLinkage(size_t childIndex)
 
     cerr << "Requested child linkage (" << childIndex << ") of "
          << name() << " is out of bounds (" << nChildren() << ")" << endl;
-    Linkage* invalidLinkage = new Linkage;
-    invalidLinkage->name("invalid");
-    return *invalidLinkage;
+    return Linkage::Invalid();
 }
 
 const vector<Joint*>& Linkage::const_joints() const { return joints_; }
@@ -782,7 +947,6 @@ bool Linkage::values(const VectorXd& allValues)
         for (size_t i = 0; i < nJoints(); ++i) {
             joints_[i]->value(allValues(i), false);
         }
-        updateFrames();
         return true;
     }
     
@@ -795,98 +959,127 @@ const TRANSFORM& Linkage::respectToFixed() const { return respectToFixed_; }
 void Linkage::respectToFixed(TRANSFORM aCoordinate)
 {
     respectToFixed_ = aCoordinate;
-    updateFrames();
+    revision_++;
+    markBaseDirty();
+    geometryChanged();
 }
 
 
 const TRANSFORM& Linkage::respectToRobot() const
 {
+    if(needsBaseUpdate_)
+        updateBase();
     return respectToRobot_;
 }
 
 
-TRANSFORM Linkage::respectToWorld() const
+const TRANSFORM& Linkage::respectToWorld() const
 {
     if(hasRobot)
-        return robot_->respectToWorld_ * respectToRobot_;
+    {
+        const TRANSFORM& base = respectToRobot();
+        if(!worldCacheValid_)
+        {
+            respectToWorldCache_ = robot_->respectToWorld_ * base;
+            worldCacheValid_ = true;
+        }
+    }
     else
-        return TRANSFORM::Identity();
+        return identityTransform();
+
+    return respectToWorldCache_;
 }
 
 void Linkage::jacobian(MatrixXd& J, TRANSLATION location, const Frame* refFrame) const
 { // location should be specified respect to linkage coordinate frame
-    
-    size_t nCols = nJoints();
-    J.resize(6, nCols);
-    
-    TRANSLATION o_i, d_i, z_i; // Joint i location, offset, axis
-    
-    for (size_t i = 0; i < nCols; ++i) {
-        
-        o_i = joints_[i]->respectToLinkage_.translation(); // Joint i location
-//        d_i = o_i - location; // Vector from location to joint i
-        d_i = location - o_i; // Changing convention so that the position vector points away from the joint axis
-//        z_i = joints_[i]->respectToLinkage_.rotation().col(2); // Joint i joint axis
-        z_i = joints_[i]->respectToLinkage_.rotation()*joints_[i]->jointAxis_;
-
-        // Set column i of Jocabian
-        if (joints_[i]->jointType_ == REVOLUTE) {
-//            J.block(0, i, 3, 1) = d_i.cross(z_i);
-            J.block(0, i, 3, 1) = z_i.cross(d_i); // Changing convention to (w x r)
-            J.block(3, i, 3, 1) = z_i;
-        } else if(joints_[i]->jointType_ == PRISMATIC) {
-            J.block(0, i, 3, 1) = z_i;
-            J.block(3, i, 3, 1) = TRANSLATION::Zero();
-        } else {
-            J.block(0, i, 3, 1) = TRANSLATION::Zero();
-            J.block(3, i, 3, 1) = TRANSLATION::Zero();
-        }
-        
-    }
-    
-    // Jacobian transformation
-    Matrix3d r(refFrame->respectToWorld().rotation().inverse() * respectToWorld().rotation());
-    MatrixXd R(6,6);
-    R << r, Matrix3d::Zero(), Matrix3d::Zero(), r;
-    J = R * J;
+    J.resize(6, nJoints());
+    jacobian(Map<Matrix6Xd>(J.data(), 6, J.cols()), joints_, location, refFrame);
 }
 
 void Linkage::jacobian(MatrixXd& J, const vector<Joint*>& jointFrames, TRANSLATION location, const Frame* refFrame) const
 { // location should be specified respect to linkage coordinate frame
+    J.resize(6, jointFrames.size());
+    jacobian(Map<Matrix6Xd>(J.data(), 6, J.cols()), jointFrames, location, refFrame);
+}
 
+void Linkage::jacobian(Ref<Matrix6Xd> J, const TRANSLATION& location, const Frame* refFrame) const
+{
+    jacobian(J, joints_, location, refFrame);
+}
+
+void Linkage::jacobian(Ref<Matrix6Xd> J, const vector<Joint*>& jointFrames, const TRANSLATION& location, const Frame* refFrame) const
+{ // location should be specified respect to linkage coordinate frame
     size_t nCols = jointFrames.size();
-    J.resize(6, nCols);
+    if((size_t)J.cols() != nCols)
+    {
+        cerr << "Jacobian workspace has " << J.cols() << " columns for "
+             << nCols << " joints" << endl;
+        return;
+    }
+
+    // Axes and offsets are rotated into refFrame before the columns are
+    // formed, since R*(z x d) = (R*z) x (R*d)
+    bool rotate = refFrame != this;
+    Matrix3d r;
+    if(rotate)
+        r = refFrame->respectToWorld().linear().transpose() * respectToWorld().linear();
 
-    TRANSLATION o_i, d_i, z_i; // Joint i location, offset, axis
+    TRANSLATION d_i, z_i; // Joint i offset, axis
 
     for (size_t i = 0; i < nCols; ++i) {
 
-        o_i = jointFrames[i]->respectToLinkage_.translation(); // Joint i location
-//        d_i = o_i - location; // Vector from location to joint i
-        d_i = location - o_i; // Changing convention so that the position vector points away from the joint axis
-//        z_i = jointFrames[i]->respectToLinkage_.rotation().col(2); // Joint i joint axis
-        z_i = jointFrames[i]->respectToLinkage_.rotation()*jointFrames[i]->jointAxis_;
+        const Joint* joint = jointFrames[i];
+        if (joint->jointType_ != REVOLUTE && joint->jointType_ != PRISMATIC) {
+            J.col(i).setZero();
+            continue;
+        }
+
+        const TRANSFORM& pose = joint->respectToLinkage();
+        d_i = location - pose.translation(); // Changing convention so that the position vector points away from the joint axis
+        z_i = pose.linear()*joint->jointAxis_;
+        if (rotate) {
+            d_i = r*d_i;
+            z_i = r*z_i;
+        }
 
         // Set column i of Jocabian
-        if (jointFrames[i]->jointType_ == REVOLUTE) {
-//            J.block(0, i, 3, 1) = d_i.cross(z_i);
-            J.block(0, i, 3, 1) = z_i.cross(d_i); // Changing convention to (w x r)
-            J.block(3, i, 3, 1) = z_i;
-        } else if(jointFrames[i]->jointType_ == PRISMATIC) {
-            J.block(0, i, 3, 1) = z_i;
-            J.block(3, i, 3, 1) = TRANSLATION::Zero();
+        if (joint->jointType_ == REVOLUTE) {
+            J.block<3,1>(0, i) = z_i.cross(d_i); // Changing convention to (w x r)
+            J.block<3,1>(3, i) = z_i;
         } else {
-            J.block(0, i, 3, 1) = TRANSLATION::Zero();
-            J.block(3, i, 3, 1) = TRANSLATION::Zero();
+            J.block<3,1>(0, i) = z_i;
+            J.block<3,1>(3, i).setZero();
         }
+    }
+}
 
+void Linkage::forwardKinematics(const VectorXd& q, vector<TRANSFORM>& framesRespectToLinkage) const
+{
+    if(q.size() != nJoints())
+    {
+        std::cerr << "ERROR! Number of values (" << q.size() << ") does not match "
+                  << "the number of joints (" << nJoints() << ")!" << std::endl;
+        return;
+    }
+
+    framesRespectToLinkage.resize(nJoints()+1);
+    for (size_t i = 0; i < joints_.size(); ++i) {
+        if (i == 0)
+            framesRespectToLinkage[i] = joints_[i]->respectToFixedTransformed(q[i]);
+        else
+            framesRespectToLinkage[i] = framesRespectToLinkage[i-1] * joints_[i]->respectToFixedTransformed(q[i]);
     }
 
-    // Jacobian transformation
-    Matrix3d r(refFrame->respectToWorld().rotation().inverse() * respectToWorld().rotation());
-    MatrixXd R(6,6);
-    R << r, Matrix3d::Zero(), Matrix3d::Zero(), r;
-    J = R * J;
+    if(joints_.size() > 0)
+        framesRespectToLinkage.back() = framesRespectToLinkage[joints_.size()-1] * tool_.respectToFixed_;
+    else
+        framesRespectToLinkage.back() = tool_.respectToFixed_;
+}
+
+void Linkage::batchForwardKinematics(const JointBatch& Q, vector<TRANSFORM>& toolPosesRespectToLinkage) const
+{
+    CompiledKinematics chain(*this);
+    chain.batchToolPoses(Q, 0, toolPosesRespectToLinkage);
 }
 
 
@@ -935,19 +1128,23 @@ void Linkage::initialize(vector<Joint> joints, Tool tool)
     
     initializing_ = false;
 
-    updateFrames();
+    markDirty();
 }
 
 void Linkage::addJoint(Joint newJoint)
 {
-    Joint* tempJoint = new Joint(newJoint);
+    Joint* tempJoint;
+    if(hasRobot && !ownsJoints_)
+        tempJoint = robot_->jointArena_.create(newJoint);
+    else
+        tempJoint = new Joint(newJoint);
     size_t newIndex = joints_.size();
     joints_.push_back(tempJoint);
     joints_[newIndex]->id_ = newIndex;
     joints_[newIndex]->localID_ = newIndex;
     joints_[newIndex]->linkage_ = this;
     joints_[newIndex]->hasLinkage = true;
-    jointNameToIndex_[joints_[newIndex]->name()] = newIndex;
+    jointNameToIndex_.insert(joints_[newIndex]->name(), newIndex);
     
     if(hasRobot)
     {
@@ -955,9 +1152,12 @@ void Linkage::addJoint(Joint newJoint)
         joints_[newIndex]->hasRobot = true;
         
         robot_->joints_.push_back(joints_[newIndex]);
-        robot_->joints_.back()->id_ = joints_.size()-1;
-        jointNameToIndex_[joints_.back()->name()] = joints_.size()-1;
+        robot_->joints_.back()->id_ = robot_->joints_.size()-1;
+        robot_->jointNameToIndex_.insert(joints_[newIndex]->name(), robot_->joints_.size()-1);
+        robot_->layout_++;
     }
+
+    markDirty();
 }
 
 void Linkage::setTool(Tool newTool)
@@ -970,6 +1170,9 @@ void Linkage::setTool(Tool newTool)
     if(hasRobot)
         tool_.Tool::robot_ = robot_;
     tool_.Tool::hasRobot = hasRobot;
+
+    markDirty();
+    geometryChanged();
 }
 
 rk_result_t Linkage::setJointValue(size_t jointIndex, double val){ return joint(jointIndex).value(val); }
@@ -977,37 +1180,99 @@ rk_result_t Linkage::setJointValue(size_t jointIndex, double val){ return joint(
 rk_result_t Linkage::setJointValue(string jointName, double val){ return joint(jointName).value(val); }
 
 
-void Linkage::updateFrames()
+void Linkage::markDirty(size_t firstJoint)
+{
+    if(needsUpdate_ && firstDirtyJoint_ <= firstJoint)
+        return; // The children were marked when this linkage became dirty
+
+    if(!needsUpdate_ || firstJoint < firstDirtyJoint_)
+        firstDirtyJoint_ = firstJoint;
+    needsUpdate_ = true;
+    markChildrenDirty();
+}
+
+void Linkage::markBaseDirty()
+{
+    needsBaseUpdate_ = true;
+    markChildrenDirty();
+}
+
+void Linkage::geometryChanged()
+{
+    if(hasRobot)
+        robot_->geometry_++;
+}
+
+void Linkage::markChildrenDirty()
+{
+    for (size_t i = 0; i < nChildren(); ++i) {
+        // A child that is already dirty has dirty descendants as well,
+        // because frames are always cleaned from the root downward
+        if(!childLinkages_[i]->needsBaseUpdate_)
+            childLinkages_[i]->markBaseDirty();
+    }
+}
+
+void Linkage::updateFrames() const
 {
-    if (~initializing_) {
-        for (size_t i = 0; i < joints_.size(); ++i) {
-            if (i == 0) {
-                joints_[i]->respectToLinkage_ = joints_[i]->respectToFixedTransformed_;
-                
-            } else {
-                joints_[i]->respectToLinkage_ = joints_[i-1]->respectToLinkage_ * joints_[i]->respectToFixedTransformed_;
-            }
+    // Joints before the first one that changed keep their frames
+    for (size_t i = firstDirtyJoint_; i < joints_.size(); ++i) {
+        joints_[i]->worldCacheValid_ = false;
+        joints_[i]->updateTransformed();
+        if (i == 0) {
+            joints_[i]->respectToLinkage_ = joints_[i]->respectToFixedTransformed_;
+
+        } else {
+            joints_[i]->respectToLinkage_ = joints_[i-1]->respectToLinkage_ * joints_[i]->respectToFixedTransformed_;
         }
-        if(joints_.size() > 0)
-            tool_.respectToLinkage_ = joints_[joints_.size()-1]->respectToLinkage_ * tool_.respectToFixed_;
-        else
-            tool_.respectToLinkage_ = tool_.respectToFixed_;
-        
-        if(hasChildren)
-            updateChildLinkage();
-        
-        needsUpdate_ = false;
     }
+    if(joints_.size() > 0)
+        tool_.respectToLinkage_ = joints_[joints_.size()-1]->respectToLinkage_ * tool_.respectToFixed_;
+    else
+        tool_.respectToLinkage_ = tool_.respectToFixed_;
+    tool_.worldCacheValid_ = false;
+
+    needsUpdate_ = false;
+    firstDirtyJoint_ = joints_.size();
+    revision_++;
 }
 
+void Linkage::updateBase() const
+{
+    // Stale bases always form a chain from some ancestor down to this
+    // linkage. Clean it from the top, one composition per linkage, instead
+    // of recursing through the parents' respectToRobot().
+    while(needsBaseUpdate_)
+    {
+        const Linkage* stale = this;
+        while(stale->hasParent && stale->parentLinkage_->needsBaseUpdate_)
+            stale = stale->parentLinkage_;
+        stale->composeBase();
+    }
+}
 
-void Linkage::updateChildLinkage()
+void Linkage::composeBase() const
 {
-    for (size_t i = 0; i < nChildren(); ++i) {
-        childLinkages_[i]->respectToRobot_ = tool_.respectToRobot() * childLinkages_[i]->respectToFixed_;
-        if(childLinkages_[i]->hasChildren)
-            childLinkages_[i]->updateChildLinkage();
+    if(hasParent)
+    {
+        const Linkage* parent = parentLinkage_;
+        if(parent->needsUpdate_)
+            parent->updateFrames();
+        respectToRobot_ = parent->respectToRobot_ * parent->tool_.respectToLinkage_ * respectToFixed_;
     }
+    else
+        respectToRobot_ = respectToFixed_;
+
+    invalidateWorld();
+    needsBaseUpdate_ = false;
+}
+
+void Linkage::invalidateWorld() const
+{
+    worldCacheValid_ = false;
+    for(size_t i=0; i<joints_.size(); i++)
+        joints_[i]->worldCacheValid_ = false;
+    tool_.worldCacheValid_ = false;
 }
 
 bool Linkage::defaultAnalyticalIK(VectorXd& q, const TRANSFORM& B, const VectorXd& qPrev) {
@@ -0,0 +1,174 @@
+/*
+ -------------------------------------------------------------------------------
+ NameTable.cpp
+ Robot Library Project
+
+ Version 1.0
+ -------------------------------------------------------------------------------
+ */
+
+
+
+//------------------------------------------------------------------------------
+// Includes
+//------------------------------------------------------------------------------
+#include "NameTable.h"
+#include <stdexcept>
+
+
+//------------------------------------------------------------------------------
+// Namespaces
+//------------------------------------------------------------------------------
+using namespace std;
+using namespace RobotKin;
+
+
+//------------------------------------------------------------------------------
+// NameTable Lifecycle
+//------------------------------------------------------------------------------
+NameTable::NameTable()
+    : size_(0),
+      used_(0)
+{
+
+}
+
+
+//------------------------------------------------------------------------------
+// NameTable Public Member Functions
+//------------------------------------------------------------------------------
+size_t NameTable::find(const string& name) const
+{
+    size_t slot = locate(name, hash(name));
+    if(slot == npos)
+        return npos;
+    return slots_[slot].index;
+}
+
+size_t NameTable::at(const string& name) const
+{
+    size_t index = find(name);
+    if(index == npos)
+        throw out_of_range("NameTable::at: no frame named " + name);
+    return index;
+}
+
+bool NameTable::contains(const string& name) const { return find(name) != npos; }
+
+void NameTable::insert(const string& name, size_t index)
+{
+    size_t h = hash(name);
+    size_t slot = locate(name, h);
+    if(slot != npos)
+    {
+        slots_[slot].index = index;
+        return;
+    }
+
+    // Keep at most half of the slots in use so probe sequences stay short.
+    // When tombstones are what fills the table, rehashing at the same size
+    // is enough to clear them.
+    if(2*(used_+1) > slots_.size())
+    {
+        if(slots_.empty())
+            rehash(16);
+        else if(4*(size_+1) > slots_.size())
+            rehash(2*slots_.size());
+        else
+            rehash(slots_.size());
+    }
+
+    size_t mask = slots_.size()-1;
+    slot = h & mask;
+    while(slots_[slot].state == FULL)
+        slot = (slot+1) & mask;
+
+    if(slots_[slot].state == EMPTY)
+        used_++;
+    slots_[slot].name = name;
+    slots_[slot].hash = h;
+    slots_[slot].index = index;
+    slots_[slot].state = FULL;
+    size_++;
+}
+
+bool NameTable::erase(const string& name)
+{
+    size_t slot = locate(name, hash(name));
+    if(slot == npos)
+        return false;
+
+    slots_[slot].name.clear();
+    slots_[slot].state = ERASED;
+    size_--;
+    return true;
+}
+
+void NameTable::clear()
+{
+    slots_.clear();
+    size_ = 0;
+    used_ = 0;
+}
+
+size_t NameTable::size() const { return size_; }
+
+
+//------------------------------------------------------------------------------
+// NameTable Protected Member Functions
+//------------------------------------------------------------------------------
+size_t NameTable::hash(const string& name)
+{
+    // FNV-1a
+    size_t h = (size_t)2166136261u;
+    for(size_t i=0; i<name.size(); i++)
+    {
+        h ^= (unsigned char)name[i];
+        h *= (size_t)16777619u;
+    }
+    return h;
+}
+
+size_t NameTable::locate(const string& name, size_t h) const
+{
+    if(slots_.empty())
+        return npos;
+
+    size_t mask = slots_.size()-1;
+    for(size_t slot = h & mask; slots_[slot].state != EMPTY; slot = (slot+1) & mask)
+        if(slots_[slot].state == FULL && slots_[slot].hash == h && slots_[slot].name == name)
+            return slot;
+
+    return npos;
+}
+
+void NameTable::rehash(size_t capacity)
+{
+    vector<Slot> old;
+    old.swap(slots_);
+
+    Slot empty;
+    empty.hash = 0;
+    empty.index = 0;
+    empty.state = EMPTY;
+    slots_.assign(capacity, empty);
+    size_ = 0;
+    used_ = 0;
+
+    size_t mask = capacity-1;
+    for(size_t i=0; i<old.size(); i++)
+    {
+        if(old[i].state != FULL)
+            continue;
+
+        size_t slot = old[i].hash & mask;
+        while(slots_[slot].state == FULL)
+            slot = (slot+1) & mask;
+        slots_[slot].name.swap(old[i].name);
+        slots_[slot].hash = old[i].hash;
+        slots_[slot].index = old[i].index;
+        slots_[slot].state = FULL;
+        size_++;
+        used_++;
+    }
+}
@@ -0,0 +1,184 @@
+/*
+ -------------------------------------------------------------------------------
+ RelativeTransforms.cpp
+ Robot Library Project
+
+ Version 1.0
+ -------------------------------------------------------------------------------
+ */
+
+
+
+//------------------------------------------------------------------------------
+// Includes
+//------------------------------------------------------------------------------
+#include "RelativeTransforms.h"
+#include "Robot.h"
+
+
+//------------------------------------------------------------------------------
+// Namespaces
+//------------------------------------------------------------------------------
+using namespace std;
+using namespace Eigen;
+using namespace RobotKin;
+
+
+//------------------------------------------------------------------------------
+// RelativeTransforms Lifecycle
+//------------------------------------------------------------------------------
+RelativeTransforms::RelativeTransforms()
+{
+
+}
+
+
+//------------------------------------------------------------------------------
+// RelativeTransforms Public Member Functions
+//------------------------------------------------------------------------------
+TRANSFORM RelativeTransforms::respectTo(const Frame& frame, const Frame& reference)
+{
+    return compose(frame, reference, NULL).toIsometry();
+}
+
+const Linkage* RelativeTransforms::lowestCommonAncestor(const Linkage* a, const Linkage* b)
+{
+    while(a != b)
+    {
+        if(depth(a) >= depth(b))
+            a = a->hasParent ? a->parentLinkage_ : NULL;
+        else
+            b = b->hasParent ? b->parentLinkage_ : NULL;
+    }
+    return a;
+}
+
+size_t RelativeTransforms::addPair(const Frame& frame, const Frame& reference)
+{
+    Pair newPair;
+    newPair.frame = &frame;
+    newPair.reference = &reference;
+    newPair.transform = compose(frame, reference, &newPair.path).toIsometry();
+
+    newPair.revisions.resize(newPair.path.size());
+    for(size_t i=0; i<newPair.path.size(); i++)
+        newPair.revisions[i] = newPair.path[i]->revision_;
+
+    pairs_.push_back(newPair);
+    return pairs_.size()-1;
+}
+
+const TRANSFORM& RelativeTransforms::pair(size_t pairIndex) const
+{
+    const Pair& p = pairs_[pairIndex];
+
+    // Reading the tool brings a linkage with pending writes up to date,
+    // which gives it a new revision
+    bool valid = true;
+    for(size_t i=0; i<p.path.size(); i++)
+    {
+        p.path[i]->const_tool().respectToLinkage();
+        if(p.path[i]->revision_ != p.revisions[i])
+        {
+            p.revisions[i] = p.path[i]->revision_;
+            valid = false;
+        }
+    }
+
+    if(!valid)
+        p.transform = compose(*p.frame, *p.reference, NULL).toIsometry();
+
+    return p.transform;
+}
+
+size_t RelativeTransforms::nPairs() const { return pairs_.size(); }
+
+void RelativeTransforms::clearPairs() { pairs_.resize(0); }
+
+
+//------------------------------------------------------------------------------
+// RelativeTransforms Protected Member Functions
+//------------------------------------------------------------------------------
+RigidTransform RelativeTransforms::compose(const Frame& frame, const Frame& reference,
+                                           vector<const Linkage*>* path)
+{
+    const Robot* robot = robotOf(frame);
+    if(robot == NULL || robot != robotOf(reference))
+        return RigidTransform(reference.respectToWorld()).inverseTimes(RigidTransform(frame.respectToWorld()));
+
+    const Linkage* a = containingLinkage(frame);
+    const Linkage* b = containingLinkage(reference);
+    RigidTransform poseA = respectToContainer(frame);
+    RigidTransform poseB = respectToContainer(reference);
+
+    while(a != b)
+    {
+        if(depth(a) >= depth(b))
+        {
+            if(path != NULL)
+                path->push_back(a);
+            a = raise(a, poseA);
+        }
+        else
+        {
+            if(path != NULL)
+                path->push_back(b);
+            b = raise(b, poseB);
+        }
+    }
+
+    if(path != NULL && a != NULL)
+        path->push_back(a);
+
+    return poseB.inverseTimes(poseA);
+}
+
+const Linkage* RelativeTransforms::containingLinkage(const Frame& frame)
+{
+    switch(frame.frameType())
+    {
+    case LINKAGE: return static_cast<const Linkage*>(&frame);
+    case JOINT:
+    case TOOL:    return frame.linkage_;
+    default:      return NULL;
+    }
+}
+
+RigidTransform RelativeTransforms::respectToContainer(const Frame& frame)
+{
+    switch(frame.frameType())
+    {
+    case JOINT: return RigidTransform(static_cast<const Joint&>(frame).respectToLinkage());
+    case TOOL:  return RigidTransform(static_cast<const Tool&>(frame).respectToLinkage());
+    default:    return RigidTransform::Identity();
+    }
+}
+
+const Linkage* RelativeTransforms::raise(const Linkage* linkage, RigidTransform& pose)
+{
+    pose = RigidTransform(linkage->respectToFixed())*pose;
+    if(!linkage->hasParent)
+        return NULL;
+
+    const Linkage* parent = linkage->parentLinkage_;
+    pose = RigidTransform(parent->const_tool().respectToLinkage())*pose;
+    return parent;
+}
+
+int RelativeTransforms::depth(const Linkage* linkage)
+{
+    if(linkage == NULL)
+        return -1;
+    return (int)linkage->depth_;
+}
+
+const Robot* RelativeTransforms::robotOf(const Frame& frame)
+{
+    if(frame.frameType() == ROBOT)
+        return static_cast<const Robot*>(&frame);
+
+    if(frame.hasRobot && (frame.frameType() != JOINT || frame.hasLinkage))
+        return frame.robot_;
+
+    return NULL;
+}
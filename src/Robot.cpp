@@ -15,6 +15,7 @@
 // Includes
 //------------------------------------------------------------------------------
 #include "Robot.h"
+#include <new>
 #include "urdf_parsing.h"
 
 
@@ -33,10 +34,13 @@ using namespace RobotKin;
 // Constructors
 Robot::Robot()
         : Frame::Frame(TRANSFORM::Identity()),
+          imposeLimits(true),
+          verbose(false),
           respectToWorld_(TRANSFORM::Identity()),
           initializing_(false),
-          imposeLimits(true),
-          verbose(false)
+          updateDepth_(0),
+          layout_(0),
+          geometry_(0)
 {
     linkages_.resize(0);
     frameType_ = ROBOT;
@@ -44,10 +48,13 @@ Robot::Robot()
 
 Robot::Robot(vector<Linkage> linkageObjs, vector<int> parentIndices)
         : Frame::Frame(TRANSFORM::Identity()),
+          imposeLimits(true),
+          verbose(false),
           respectToWorld_(TRANSFORM::Identity()),
           initializing_(false),
-          imposeLimits(true),
-          verbose(false)
+          updateDepth_(0),
+          layout_(0),
+          geometry_(0)
 {
     frameType_ = ROBOT;
     
@@ -55,12 +62,33 @@ Robot::Robot(vector<Linkage> linkageObjs, vector<int> parentIndices)
     initialize(linkageObjs, parentIndices);
 }
 
+Robot::Robot(const Robot& robot)
+        : Frame::Frame(robot.respectToFixed_, robot.name_, robot.id_, ROBOT),
+          rootLink(robot.rootLink),
+          imposeLimits(robot.imposeLimits),
+          verbose(robot.verbose),
+          respectToWorld_(robot.respectToWorld_),
+          linkageArena_(robot.linkages_.size()),
+          jointArena_(robot.joints_.size()),
+          initializing_(false),
+          updateDepth_(0),
+          layout_(0),
+          geometry_(0)
+{
+    gravity_constant = robot.gravity_constant;
+    copyStructure(robot);
+}
+
 #ifdef HAVE_URDF_PARSE
 Robot::Robot(string filename, string name, size_t id)
     : Frame::Frame(TRANSFORM::Identity(), name, id, ROBOT),
+      imposeLimits(true),
+      verbose(false),
       respectToWorld_(TRANSFORM::Identity()),
       initializing_(false),
-      verbose(false)
+      updateDepth_(0),
+      layout_(0),
+      geometry_(0)
 {
     // TODO: Test to make sure filename ends with ".urdf"
     linkages_.resize(0);
@@ -79,10 +107,13 @@ bool Robot::loadURDFString(string filename)
 #else  // HAVE_URDF_PARSE
 Robot::Robot(string filename, string name, size_t id)
     : Frame::Frame(TRANSFORM::Identity(), name, id, ROBOT),
+      imposeLimits(true),
+      verbose(false),
       respectToWorld_(TRANSFORM::Identity()),
       initializing_(false),
-      imposeLimits(true),
-      verbose(false)
+      updateDepth_(0),
+      layout_(0),
+      geometry_(0)
 {
     std::cerr << "There was no URDF Parser installed when you compiled RobotKin!" << std::endl;
 }
@@ -109,10 +140,23 @@ Robot::~Robot()
 }
 
 
+Robot* Robot::clone() const { return new Robot(*this); }
+
+
 Robot& Robot::Default()
 {
-    Robot* tempRobot = new Robot;
-    return *tempRobot;
+    static Robot defaultRobot;
+    return defaultRobot;
+}
+
+Robot& Robot::Invalid()
+{
+    // Robots can not be assigned, so it is rebuilt in place instead
+    static Robot invalidRobot;
+    invalidRobot.~Robot();
+    new (&invalidRobot) Robot();
+    invalidRobot.name_ = "invalid";
+    return invalidRobot;
 }
 
 
@@ -123,9 +167,9 @@ size_t Robot::nLinkages() const { return linkages_.size(); }
 
 size_t Robot::linkageIndex(string linkageName) const
 {
-    map<string,size_t>::const_iterator j = linkageNameToIndex_.find(linkageName);
-    if( j != linkageNameToIndex_.end() )
-        return j->second;
+    size_t j = linkageNameToIndex_.find(linkageName);
+    if( j != NameTable::npos )
+        return j;
 
     return 0;
 }
@@ -133,13 +177,12 @@ size_t Robot::linkageIndex(string linkageName) const
 rk_result_t Robot::jointNamesToIndices(const vector<string> &jointNames, vector<size_t> &jointIndices)
 {
     jointIndices.resize(jointNames.size());
-    map<string,size_t>::iterator j;
     for(int i=0; i<jointNames.size(); i++)
     {
-        j = jointNameToIndex_.find(jointNames[i]);
-        if( j == jointNameToIndex_.end() )
+        size_t j = jointNameToIndex_.find(jointNames[i]);
+        if( j == NameTable::npos )
             return RK_INVALID_JOINT;
-        jointIndices[i] = j->second;
+        jointIndices[i] = j;
     }
 
     return RK_SOLVED;
@@ -148,13 +191,12 @@ rk_result_t Robot::jointNamesToIndices(const vector<string> &jointNames, vector<
 rk_result_t Robot::linkageNamesToIndices(const vector<string> &linkageNames, vector<size_t> &linkageIndices)
 {
     linkageIndices.resize(linkageNames.size());
-    map<string,size_t>::iterator j;
     for(int i=0; i<linkageNames.size(); i++)
     {
-        j = linkageNameToIndex_.find(linkageNames[i]);
-        if( j == linkageNameToIndex_.end() )
+        size_t j = linkageNameToIndex_.find(linkageNames[i]);
+        if( j == NameTable::npos )
             return RK_INVALID_LINKAGE;
-        linkageIndices[i] = j->second;
+        linkageIndices[i] = j;
     }
 
     return RK_SOLVED;
@@ -169,22 +211,18 @@ const Linkage& Robot::const_linkage(string linkageName) const { return *linkages
 
 Linkage& Robot::linkage(size_t linkageIndex)
 { // FIXME: Remove assert
-    if(linkageIndex < nJoints())
+    if(linkageIndex < nLinkages())
         return *linkages_[linkageIndex];
 
-    Linkage* invalidLinkage = new Linkage;
-    invalidLinkage->name("invalid");
-    return *invalidLinkage;
+    return Linkage::Invalid();
 }
 Linkage& Robot::linkage(string linkageName)
 {
-    map<string,size_t>::iterator j = linkageNameToIndex_.find(linkageName);
-    if( j != linkageNameToIndex_.end() )
-        return *linkages_.at(j->second);
+    size_t j = linkageNameToIndex_.find(linkageName);
+    if( j != NameTable::npos )
+        return *linkages_.at(j);
 
-    Linkage* invalidLinkage = new Linkage;
-    invalidLinkage->name("invalid");
-    return *invalidLinkage;
+    return Linkage::Invalid();
 }
 
 const vector<Linkage*>& Robot::const_linkages() const { return linkages_; }
@@ -200,19 +238,15 @@ const Joint& Robot::const_joint(size_t jointIndex) const
     if(jointIndex < nJoints())
         return *joints_[jointIndex];
 
-    Joint* invalidJoint = new Joint;
-    invalidJoint->name("invalid");
-    return *invalidJoint;
+    return Joint::ConstInvalid();
 }
 const Joint& Robot::const_joint(string jointName) const
 {
-    map<string,size_t>::const_iterator j = jointNameToIndex_.find(jointName);
-    if( j != jointNameToIndex_.end() )
-        return *joints_.at(j->second);
+    size_t j = jointNameToIndex_.find(jointName);
+    if( j != NameTable::npos )
+        return *joints_.at(j);
 
-    Joint* invalidJoint = new Joint;
-    invalidJoint->name("invalid");
-    return *invalidJoint;
+    return Joint::ConstInvalid();
 }
 
 Joint& Robot::joint(size_t jointIndex)
@@ -221,20 +255,16 @@ Joint& Robot::joint(size_t jointIndex)
         return *joints_[jointIndex];
 
     cerr << "Invalid joint index: (" << jointIndex << ")" << endl;
-    Joint* invalidJoint = new Joint;
-    invalidJoint->name("invalid");
-    return *invalidJoint;
+    return Joint::Invalid();
 }
 Joint& Robot::joint(string jointName)
 {
-    map<string,size_t>::const_iterator j = jointNameToIndex_.find(jointName);
-    if( j != jointNameToIndex_.end() )
-        return *joints_.at(j->second);
+    size_t j = jointNameToIndex_.find(jointName);
+    if( j != NameTable::npos )
+        return *joints_.at(j);
 
     cerr << "Invalid joint name: (" << jointName << ")" << endl;
-    Joint* invalidJoint = new Joint;
-    invalidJoint->name("invalid");
-    return *invalidJoint;
+    return Joint::Invalid();
 }
 
 const vector<Joint*>& Robot::const_joints() const { return joints_; }
@@ -255,9 +285,8 @@ void Robot::values(const VectorXd& allValues) {
     if(allValues.size() == nJoints())
     {
         for (size_t i = 0; i < nJoints(); ++i) {
-            joints_[i]->value(allValues(i), true);
+            joints_[i]->value(allValues(i), false);
         }
-        updateFrames();
     }
     else
         cerr << "Invalid number of joint values: " << allValues.size()
@@ -271,8 +300,7 @@ void Robot::values(const vector<size_t>& jointIndices, const VectorXd& jointValu
     if( jointIndices.size() == jointValues.size() )
     {
         for(size_t i=0; i<jointIndices.size(); i++)
-            joints_[jointIndices[i]]->value(jointValues[i], true);
-        updateFrames();
+            joints_[jointIndices[i]]->value(jointValues[i], false);
     }
     else
         cerr << "Invalid number of joint values: " << jointValues.size()
@@ -285,6 +313,159 @@ rk_result_t Robot::setJointValue(string jointName, double val, bool update){ ret
 
 rk_result_t Robot::setJointValue(size_t jointIndex, double val, bool update){ return joint(jointIndex).value(val, update); }
 
+JointHandle Robot::jointHandle(string jointName) const
+{
+    JointHandle handle;
+    size_t j = jointNameToIndex_.find(jointName);
+    if( j == NameTable::npos )
+    {
+        cerr << "Invalid joint name: (" << jointName << ")" << endl;
+        return handle;
+    }
+
+    handle.index = j;
+    handle.robot = this;
+    handle.layout = layout_;
+    return handle;
+}
+
+LinkageHandle Robot::linkageHandle(string linkageName) const
+{
+    LinkageHandle handle;
+    size_t l = linkageNameToIndex_.find(linkageName);
+    if( l == NameTable::npos )
+    {
+        cerr << "Invalid linkage name: (" << linkageName << ")" << endl;
+        return handle;
+    }
+
+    handle.index = l;
+    handle.robot = this;
+    handle.layout = layout_;
+    return handle;
+}
+
+JointGroupHandle Robot::jointGroupHandle(const vector<string>& jointNames) const
+{
+    JointGroupHandle handle;
+    handle.indices.resize(jointNames.size());
+    for(size_t i=0; i<jointNames.size(); i++)
+    {
+        size_t j = jointNameToIndex_.find(jointNames[i]);
+        if( j == NameTable::npos )
+        {
+            cerr << "Invalid joint name: (" << jointNames[i] << ")" << endl;
+            handle.indices.resize(0);
+            return handle;
+        }
+        handle.indices[i] = j;
+    }
+
+    handle.robot = this;
+    handle.layout = layout_;
+    return handle;
+}
+
+JointGroupHandle Robot::jointGroupHandle(const LinkageHandle& linkage) const
+{
+    JointGroupHandle handle;
+    if(!isValid(linkage))
+        return handle;
+
+    const Linkage& l = *linkages_[linkage.index];
+    handle.indices.resize(l.nJoints());
+    for(size_t i=0; i<l.nJoints(); i++)
+        handle.indices[i] = l.joints_[i]->id();
+
+    handle.linkage = (int)linkage.index;
+    handle.robot = this;
+    handle.layout = layout_;
+    return handle;
+}
+
+bool Robot::isValid(const JointHandle& handle) const
+{
+    return handle.robot == this && handle.layout == layout_ && handle.index < joints_.size();
+}
+
+bool Robot::isValid(const LinkageHandle& handle) const
+{
+    return handle.robot == this && handle.layout == layout_ && handle.index < linkages_.size();
+}
+
+bool Robot::isValid(const JointGroupHandle& handle) const
+{
+    return handle.robot == this && handle.layout == layout_;
+}
+
+const Joint& Robot::const_joint(const JointHandle& handle) const
+{
+    if(isValid(handle))
+        return *joints_[handle.index];
+
+    return const_joint(joints_.size());
+}
+
+Joint& Robot::joint(const JointHandle& handle)
+{
+    if(isValid(handle))
+        return *joints_[handle.index];
+
+    cerr << "Invalid joint handle" << endl;
+    return joint(joints_.size());
+}
+
+const Linkage& Robot::const_linkage(const LinkageHandle& handle) const
+{
+    if(isValid(handle))
+        return *linkages_[handle.index];
+
+    return Linkage::ConstInvalid();
+}
+
+Linkage& Robot::linkage(const LinkageHandle& handle)
+{
+    if(isValid(handle))
+        return *linkages_[handle.index];
+
+    cerr << "Invalid linkage handle" << endl;
+    return linkage(linkages_.size());
+}
+
+rk_result_t Robot::setJointValue(const JointHandle& handle, double val, bool update)
+{
+    if(!isValid(handle))
+        return RK_INVALID_JOINT;
+
+    return joints_[handle.index]->value(val, update);
+}
+
+VectorXd Robot::values(const JointGroupHandle& group) const
+{
+    VectorXd theValues(group.indices.size());
+    if(!isValid(group))
+    {
+        cerr << "Invalid joint group handle" << endl;
+        theValues.setZero();
+        return theValues;
+    }
+
+    for(size_t i=0; i<group.indices.size(); i++)
+        theValues[i] = joints_[group.indices[i]]->value();
+    return theValues;
+}
+
+void Robot::values(const JointGroupHandle& group, const VectorXd& jointValues)
+{
+    if(!isValid(group))
+    {
+        cerr << "Invalid joint group handle" << endl;
+        return;
+    }
+
+    values(group.indices, jointValues);
+}
+
 const TRANSFORM& Robot::respectToFixed() const { return respectToFixed_; }
 void Robot::respectToFixed(TRANSFORM aCoordinate)
 {
@@ -292,7 +473,7 @@ void Robot::respectToFixed(TRANSFORM aCoordinate)
     updateFrames();
 }
 
-TRANSFORM Robot::respectToWorld() const
+const TRANSFORM& Robot::respectToWorld() const
 {
     return respectToWorld_;
 }
@@ -300,42 +481,555 @@ TRANSFORM Robot::respectToWorld() const
 void Robot::respectToWorld( TRANSFORM _Tworld )
 {
     respectToWorld_ = _Tworld;
+    for(size_t i=0; i<linkages_.size(); i++)
+        linkages_[i]->invalidateWorld();
 }
 
 void Robot::jacobian(MatrixXd& J, const vector<Joint*>& jointFrames, TRANSLATION location, const Frame* refFrame) const
+{ // location should be specified in respect to robot coordinates
+    J.resize(6, jointFrames.size());
+    jacobian(Map<Matrix6Xd>(J.data(), 6, J.cols()), jointFrames, location, refFrame);
+}
+
+void Robot::jacobian(Ref<Matrix6Xd> J, const vector<Joint*>& jointFrames, const TRANSLATION& location, const Frame* refFrame) const
 { // location should be specified in respect to robot coordinates
     size_t nCols = jointFrames.size();
-    J.resize(6, nCols);
-    
-    TRANSLATION o_i, d_i; AXIS z_i; // Joint i location, offset, axis
-    
+    if((size_t)J.cols() != nCols)
+    {
+        cerr << "Jacobian workspace has " << J.cols() << " columns for "
+             << nCols << " joints" << endl;
+        return;
+    }
+
+    // Axes and offsets are rotated into refFrame before the columns are
+    // formed, since R*(z x d) = (R*z) x (R*d)
+    bool rotate = refFrame != this;
+    Matrix3d r;
+    if(rotate)
+        r = refFrame->respectToWorld().linear().transpose() * respectToWorld_.linear();
+
+    TRANSFORM pose;
+    TRANSLATION d_i; AXIS z_i; // Joint i offset, axis
+
     for (size_t i = 0; i < nCols; i++) {
 
-        o_i = jointFrames[i]->respectToRobot().translation(); // Joint i location
-        d_i = location - o_i; // Changing convention so that the position vector points away from the joint axis
-        z_i = jointFrames[i]->respectToRobot().rotation()*jointFrames[i]->jointAxis_;
+        const Joint* joint = jointFrames[i];
+        if (joint->jointType_ != REVOLUTE && joint->jointType_ != PRISMATIC) {
+            J.col(i).setZero();
+            continue;
+        }
+
+        pose = joint->respectToRobot();
+        d_i = location - pose.translation(); // Changing convention so that the position vector points away from the joint axis
+        z_i = pose.linear()*joint->jointAxis_;
+        if (rotate) {
+            d_i = r*d_i;
+            z_i = r*z_i;
+        }
 
-//        cout << jointFrames[i]->name() << " " << d_i.transpose() << " : " << z_i.transpose() << endl;
-        
         // Set column i of Jocabian
-        if (jointFrames[i]->jointType_ == REVOLUTE) {
-            J.block(0, i, 3, 1) = z_i.cross(d_i);
-            J.block(3, i, 3, 1) = z_i;
-        } else if(jointFrames[i]->jointType_ == PRISMATIC) {
-            J.block(0, i, 3, 1) = z_i;
-            J.block(3, i, 3, 1) = AXIS::Zero();
+        if (joint->jointType_ == REVOLUTE) {
+            J.block<3,1>(0, i) = z_i.cross(d_i);
+            J.block<3,1>(3, i) = z_i;
         } else {
-            J.block(0, i, 3, 1) = AXIS::Zero();
-            J.block(3, i, 3, 1) = AXIS::Zero();
+            J.block<3,1>(0, i) = z_i;
+            J.block<3,1>(3, i).setZero();
         }
-        
     }
-    
-    // Jacobian transformation
-    Matrix3d r(refFrame->respectToWorld().rotation().inverse() * respectToWorld_.rotation());
-    MatrixXd R(6,6);
-    R << r, Matrix3d::Zero(), Matrix3d::Zero(), r;
-    J = R * J;
+}
+
+void Robot::frameJacobian(FrameJacobian& result, const Frame& frame, const TRANSLATION& point, const Frame* refFrame) const
+{
+    result.jointIndices.resize(0);
+    result.joints.resize(0);
+
+    // Linkage holding the frame, the number of its joints that move the
+    // frame, and the frame's pose with respect to the robot
+    const Linkage* linkage = NULL;
+    size_t nMoving = 0;
+    TRANSFORM pose = TRANSFORM::Identity();
+    bool valid = true;
+    switch(frame.frameType())
+    {
+    case JOINT:
+    {
+        const Joint& joint = static_cast<const Joint&>(frame);
+        valid = joint.hasLinkage && joint.robot_ == this;
+        if(valid)
+        {
+            linkage = joint.linkage_;
+            nMoving = joint.localID_+1;
+            pose = joint.respectToRobot();
+        }
+        break;
+    }
+    case TOOL:
+    {
+        const Tool& tool = static_cast<const Tool&>(frame);
+        valid = tool.hasLinkage && tool.robot_ == this;
+        if(valid)
+        {
+            linkage = tool.linkage_;
+            nMoving = linkage->joints_.size();
+            pose = tool.respectToRobot();
+        }
+        break;
+    }
+    case LINKAGE:
+        linkage = static_cast<const Linkage*>(&frame);
+        valid = linkage->hasRobot && linkage->robot_ == this;
+        if(valid)
+            pose = linkage->respectToRobot();
+        break;
+    case ROBOT:
+        valid = &frame == this;
+        break;
+    default:
+        valid = false;
+    }
+
+    if(!valid)
+    {
+        cerr << "Frame " << frame.name() << " does not belong to robot " << name() << endl;
+        result.J.resize(6, 0);
+        return;
+    }
+
+    // Walk up to the root, then list the joints root first, which is
+    // ascending joint index order
+    size_t nJoints = nMoving;
+    for(const Linkage* l = linkage; l != NULL && l->hasParent; l = l->parentLinkage_)
+        nJoints += l->parentLinkage_->joints_.size();
+
+    result.joints.resize(nJoints);
+    size_t end = nJoints-nMoving;
+    for(size_t i=0; i<nMoving; i++)
+        result.joints[end+i] = linkage->joints_[i];
+    for(const Linkage* l = linkage; l != NULL && l->hasParent; l = l->parentLinkage_)
+    {
+        const vector<Joint*>& parentJoints = l->parentLinkage_->joints_;
+        end -= parentJoints.size();
+        for(size_t i=0; i<parentJoints.size(); i++)
+            result.joints[end+i] = parentJoints[i];
+    }
+
+    result.jointIndices.resize(nJoints);
+    for(size_t i=0; i<nJoints; i++)
+        result.jointIndices[i] = result.joints[i]->id_;
+
+    result.J.resize(6, nJoints);
+    jacobian(result.J, result.joints, pose*point, refFrame);
+}
+
+void Robot::frameJacobian(MatrixXd& J, const Frame& frame, const TRANSLATION& point, const Frame* refFrame) const
+{
+    FrameJacobian sparse;
+    frameJacobian(sparse, frame, point, refFrame);
+
+    J.setZero(6, nJoints());
+    for(size_t i=0; i<sparse.jointIndices.size(); i++)
+        J.col(sparse.jointIndices[i]) = sparse.J.col(i);
+}
+
+void Robot::jacobianDot(MatrixXd& Jdot, const vector<size_t>& jointIndices, const VectorXd& qdot,
+                        const TRANSLATION& location, const Frame* refFrame) const
+{
+    MatrixXd J;
+    jacobianDot(J, Jdot, jointIndices, qdot, location, refFrame);
+}
+
+void Robot::jacobianDot(MatrixXd& J, MatrixXd& Jdot, const vector<size_t>& jointIndices, const VectorXd& qdot,
+                        const TRANSLATION& location, const Frame* refFrame) const
+{ // location should be specified in respect to robot coordinates
+    size_t nCols = jointIndices.size();
+    if((size_t)qdot.size() != nCols)
+    {
+        cerr << "Invalid number of joint velocities: " << qdot.size()
+             << "\n\t This should be equal to " << nCols << endl;
+        return;
+    }
+    for(size_t i=0; i<nCols; i++)
+    {
+        if(jointIndices[i] >= nJoints())
+        {
+            cerr << "Invalid joint index: " << jointIndices[i] << endl;
+            return;
+        }
+    }
+
+    J.resize(6, nCols);
+    Jdot.resize(6, nCols);
+
+    // Joint origins and axes with respect to the robot
+    Matrix3Xd o(3, nCols), z(3, nCols);
+    for(size_t i=0; i<nCols; i++)
+    {
+        const Joint* joint = joints_[jointIndices[i]];
+        TRANSFORM pose = joint->respectToRobot();
+        o.col(i) = pose.translation();
+        z.col(i) = pose.linear()*joint->jointAxis_;
+    }
+
+    // Columns of J and the velocity of location
+    TRANSLATION v = TRANSLATION::Zero();
+    for(size_t i=0; i<nCols; i++)
+    {
+        JointType type = joints_[jointIndices[i]]->jointType_;
+        if(type == REVOLUTE) {
+            J.block<3,1>(0, i) = z.col(i).cross(location - o.col(i));
+            J.block<3,1>(3, i) = z.col(i);
+        } else if(type == PRISMATIC) {
+            J.block<3,1>(0, i) = z.col(i);
+            J.block<3,1>(3, i).setZero();
+        } else
+            J.col(i).setZero();
+        v += J.block<3,1>(0, i)*qdot[i];
+    }
+
+    // The axis of joint i turns with the angular velocity w_i of its frame,
+    // and its origin moves with velocity do_i, both due to the joints before
+    // it. Differentiating the columns above gives
+    //   revolute:  [ dz_i x (p - o_i) + z_i x (dp - do_i) ; dz_i ]
+    //   prismatic: [ dz_i ; 0 ]
+    // with dz_i = w_i x z_i.
+    AXIS w, dz;
+    TRANSLATION dO;
+    for(size_t i=0; i<nCols; i++)
+    {
+        const Joint* joint = joints_[jointIndices[i]];
+        w.setZero();
+        dO.setZero();
+        for(size_t j=0; j<nCols; j++)
+        {
+            const Joint* mover = joints_[jointIndices[j]];
+            if(!moves(*mover, *joint))
+                continue;
+
+            if(mover->jointType_ == REVOLUTE) {
+                w += z.col(j)*qdot[j];
+                dO += z.col(j).cross(o.col(i) - o.col(j))*qdot[j];
+            } else if(mover->jointType_ == PRISMATIC) {
+                dO += z.col(j)*qdot[j];
+            }
+        }
+
+        dz = w.cross(z.col(i));
+        if(joint->jointType_ == REVOLUTE) {
+            Jdot.block<3,1>(0, i) = dz.cross(location - o.col(i)) + z.col(i).cross(v - dO);
+            Jdot.block<3,1>(3, i) = dz;
+        } else if(joint->jointType_ == PRISMATIC) {
+            Jdot.block<3,1>(0, i) = dz;
+            Jdot.block<3,1>(3, i).setZero();
+        } else
+            Jdot.col(i).setZero();
+    }
+
+    if(refFrame != this)
+    {
+        Matrix3d r(refFrame->respectToWorld().linear().transpose() * respectToWorld_.linear());
+        J.topRows<3>() = r*J.topRows<3>();
+        J.bottomRows<3>() = r*J.bottomRows<3>();
+        Jdot.topRows<3>() = r*Jdot.topRows<3>();
+        Jdot.bottomRows<3>() = r*Jdot.bottomRows<3>();
+    }
+}
+
+void Robot::hessian(vector<Matrix6Xd>& H, const vector<size_t>& jointIndices,
+                    const TRANSLATION& location, const Frame* refFrame) const
+{ // location should be specified in respect to robot coordinates
+    size_t nCols = jointIndices.size();
+    for(size_t i=0; i<nCols; i++)
+    {
+        if(jointIndices[i] >= nJoints())
+        {
+            cerr << "Invalid joint index: " << jointIndices[i] << endl;
+            return;
+        }
+    }
+
+    // Only differences of points and cross products appear below, so the
+    // axes, origins and location can be rotated into refFrame up front
+    Matrix3d r = Matrix3d::Identity();
+    if(refFrame != this)
+        r = refFrame->respectToWorld().linear().transpose() * respectToWorld_.linear();
+
+    Matrix3Xd o(3, nCols), z(3, nCols);
+    for(size_t i=0; i<nCols; i++)
+    {
+        const Joint* joint = joints_[jointIndices[i]];
+        TRANSFORM pose = joint->respectToRobot();
+        o.col(i) = r*pose.translation();
+        z.col(i) = r*(pose.linear()*joint->jointAxis_);
+    }
+    TRANSLATION p = r*location;
+
+    // With z_i, o_i the axis and origin of joint i and p the location, the
+    // derivative of column i with respect to revolute joint j is
+    //   j moves i:  [ (z_j x z_i) x (p - o_i) + z_i x (z_j x (p - o_i)) ; z_j x z_i ]
+    //   otherwise:  [ z_i x (z_j x (p - o_j)) ; 0 ]
+    // for revolute i, and [ z_j x z_i ; 0 ] or zero for prismatic i. A
+    // prismatic joint j only moves p, giving [ z_i x z_j ; 0 ] for revolute
+    // i when j does not move i.
+    H.resize(nCols);
+    for(size_t j=0; j<nCols; j++)
+    {
+        Matrix6Xd& Hj = H[j];
+        Hj.setZero(6, nCols);
+
+        const Joint* mover = joints_[jointIndices[j]];
+        if(mover->jointType_ != REVOLUTE && mover->jointType_ != PRISMATIC)
+            continue;
+
+        for(size_t i=0; i<nCols; i++)
+        {
+            const Joint* joint = joints_[jointIndices[i]];
+            bool revolute = mover->jointType_ == REVOLUTE;
+            bool inChain = moves(*mover, *joint);
+
+            if(joint->jointType_ == REVOLUTE)
+            {
+                if(revolute && inChain)
+                {
+                    AXIS dz = z.col(j).cross(z.col(i));
+                    TRANSLATION d = p - o.col(i);
+                    Hj.block<3,1>(0, i) = dz.cross(d) + z.col(i).cross(z.col(j).cross(d));
+                    Hj.block<3,1>(3, i) = dz;
+                }
+                else if(revolute)
+                    Hj.block<3,1>(0, i) = z.col(i).cross(z.col(j).cross(p - o.col(j)));
+                else if(!inChain)
+                    Hj.block<3,1>(0, i) = z.col(i).cross(z.col(j));
+            }
+            else if(joint->jointType_ == PRISMATIC && revolute && inChain)
+                Hj.block<3,1>(0, i) = z.col(j).cross(z.col(i));
+        }
+    }
+}
+
+void Robot::forwardKinematics(const VectorXd& q, vector<TRANSFORM>& jointPoses) const
+{
+    if(q.size() != nJoints())
+    {
+        cerr << "Invalid number of joint values: " << q.size()
+             << "\n\t This should be equal to " << nJoints() << endl;
+        return;
+    }
+
+    jointPoses.resize(nJoints());
+
+    // Linkages are stored parents first, so every base can be taken from the
+    // parent's joint poses that were already written
+    for(size_t l=0; l<linkages_.size(); l++)
+    {
+        const Linkage* linkage = linkages_[l];
+        if(linkage->nJoints() == 0)
+            continue;
+
+        TRANSFORM pose = forwardKinematicsBase(l, jointPoses);
+        for(size_t j=0; j<linkage->nJoints(); j++)
+        {
+            const Joint* joint = linkage->joints_[j];
+            pose = pose * joint->respectToFixedTransformed(q[joint->id()]);
+            jointPoses[joint->id()] = pose;
+        }
+    }
+}
+
+void Robot::forwardKinematics(const VectorXd& q, vector<TRANSFORM>& jointPoses,
+                              vector<TRANSFORM>& toolPoses) const
+{
+    forwardKinematics(q, jointPoses);
+    if(q.size() != nJoints())
+        return; // Reported above; jointPoses may still hold an older result
+
+    toolPoses.resize(nLinkages());
+    for(size_t l=0; l<linkages_.size(); l++)
+        toolPoses[l] = forwardKinematicsTool(l, jointPoses);
+}
+
+TRANSFORM Robot::forwardKinematicsTool(size_t linkageIndex, const vector<TRANSFORM>& jointPoses) const
+{
+    const Linkage* linkage = linkages_[linkageIndex];
+    if(linkage->nJoints() > 0)
+        return jointPoses[linkage->joints_.back()->id()] * linkage->tool_.respectToFixed_;
+
+    return forwardKinematicsBase(linkageIndex, jointPoses) * linkage->tool_.respectToFixed_;
+}
+
+TRANSFORM Robot::forwardKinematicsBase(size_t linkageIndex, const vector<TRANSFORM>& jointPoses) const
+{
+    const Linkage* linkage = linkages_[linkageIndex];
+    if(linkage->hasParent)
+        return forwardKinematicsTool(linkage->parentLinkage_->id(), jointPoses) * linkage->respectToFixed_;
+
+    return linkage->respectToFixed_;
+}
+
+void Robot::beginUpdate()
+{
+    updateDepth_++;
+}
+
+void Robot::commit()
+{
+    if(updateDepth_ == 0)
+    {
+        cerr << "Robot::commit() was called without a matching beginUpdate()" << endl;
+        return;
+    }
+
+    updateDepth_--;
+    if(updateDepth_ == 0)
+        updateFrames();
+}
+
+bool Robot::updating() const { return updateDepth_ > 0; }
+
+JointWriteBatch::JointWriteBatch(Robot &robot)
+    : robot_(robot),
+      open_(true)
+{
+    robot_.beginUpdate();
+}
+
+JointWriteBatch::~JointWriteBatch()
+{
+    commit();
+}
+
+void JointWriteBatch::commit()
+{
+    if(open_)
+    {
+        robot_.commit();
+        open_ = false;
+    }
+}
+
+RobotSnapshot::RobotSnapshot()
+    : robot_(NULL),
+      layout_(0),
+      geometry_(0),
+      imposeLimits_(true)
+{
+
+}
+
+bool RobotSnapshot::empty() const { return robot_ == NULL; }
+size_t RobotSnapshot::nJoints() const { return joints_.size(); }
+size_t RobotSnapshot::nLinkages() const { return linkages_.size(); }
+
+void Robot::snapshot(RobotSnapshot& snapshot) const
+{
+    snapshot.linkages_.resize(linkages_.size());
+    snapshot.joints_.resize(joints_.size());
+
+    size_t j = 0;
+    for(size_t l=0; l<linkages_.size(); l++)
+        saveLinkage(snapshot, l, l, j);
+
+    snapshot.robot_ = this;
+    snapshot.layout_ = layout_;
+    snapshot.geometry_ = geometry_;
+    snapshot.imposeLimits_ = imposeLimits;
+}
+
+void Robot::snapshot(RobotSnapshot& snapshot, size_t linkageIndex) const
+{
+    snapshot.linkages_.resize(0);
+    snapshot.joints_.resize(0);
+    snapshot.robot_ = NULL;
+    if(linkageIndex >= linkages_.size())
+    {
+        cerr << "Invalid linkage index for a snapshot: (" << linkageIndex << ")" << endl;
+        return;
+    }
+
+    // Descendants come after their ancestors in linkages_, so one forward
+    // scan finds all of them
+    vector<bool> inSubtree(linkages_.size(), false);
+    inSubtree[linkageIndex] = true;
+    size_t nLinkages = 0, nJoints = 0;
+    for(size_t l=linkageIndex; l<linkages_.size(); l++)
+    {
+        const Linkage* linkage = linkages_[l];
+        if(l != linkageIndex)
+            inSubtree[l] = linkage->hasParent && inSubtree[linkage->parentLinkage_->id_];
+        if(inSubtree[l])
+        {
+            nLinkages++;
+            nJoints += linkage->joints_.size();
+        }
+    }
+
+    snapshot.linkages_.resize(nLinkages);
+    snapshot.joints_.resize(nJoints);
+    size_t k = 0, j = 0;
+    for(size_t l=linkageIndex; l<linkages_.size(); l++)
+        if(inSubtree[l])
+            saveLinkage(snapshot, l, k++, j);
+
+    snapshot.robot_ = this;
+    snapshot.layout_ = layout_;
+    snapshot.geometry_ = geometry_;
+    snapshot.imposeLimits_ = imposeLimits;
+}
+
+bool Robot::restore(const RobotSnapshot& snapshot)
+{
+    if(snapshot.robot_ != this || snapshot.layout_ != layout_)
+    {
+        cerr << "Snapshot does not belong to robot " << name() << " as it is now" << endl;
+        return false;
+    }
+
+    // The saved frames were computed from the geometry of that time
+    if(snapshot.geometry_ != geometry_)
+    {
+        cerr << "The geometry of robot " << name() << " changed since the snapshot was taken" << endl;
+        return false;
+    }
+
+    // The first record of a partial snapshot is the root of its subtree.
+    // Its parent is not restored and may have changed since, so its base
+    // is recomputed rather than restored.
+    Linkage* subtreeRoot = NULL;
+    if(!snapshot.linkages_.empty() && linkages_[snapshot.linkages_[0].linkage]->hasParent)
+        subtreeRoot = linkages_[snapshot.linkages_[0].linkage];
+
+    size_t j = 0;
+    for(size_t k=0; k<snapshot.linkages_.size(); k++)
+    {
+        const RobotSnapshot::LinkageRecord& record = snapshot.linkages_[k];
+        Linkage* linkage = linkages_[record.linkage];
+        if(linkage != subtreeRoot)
+        {
+            linkage->respectToRobot_ = record.respectToRobot;
+            linkage->needsBaseUpdate_ = record.needsBaseUpdate;
+        }
+        linkage->tool_.respectToLinkage_ = record.toolRespectToLinkage;
+        linkage->needsUpdate_ = record.needsUpdate;
+        linkage->firstDirtyJoint_ = record.firstDirtyJoint;
+        linkage->revision_++;
+
+        for(size_t i=0; i<linkage->joints_.size(); i++, j++)
+        {
+            const RobotSnapshot::JointRecord& saved = snapshot.joints_[j];
+            Joint* joint = linkage->joints_[i];
+            joint->value_ = saved.value;
+            joint->respectToFixedTransformed_ = saved.respectToFixedTransformed;
+            joint->respectToLinkage_ = saved.respectToLinkage;
+        }
+
+        // World frames are recomputed from the restored frames on demand
+        linkage->invalidateWorld();
+    }
+
+    if(subtreeRoot != NULL)
+        subtreeRoot->markBaseDirty();
+
+    imposeLimits = snapshot.imposeLimits_;
+    return true;
 }
 
 void Robot::printInfo() const
@@ -365,9 +1059,238 @@ void Robot::printInfo() const
     }
 }
 
+size_t Robot::collapseAnchors()
+{
+    size_t removed = 0;
+
+    for(size_t l=0; l<linkages_.size(); l++)
+    {
+        Linkage* linkage = linkages_[l];
+        vector<Joint*> kept;
+
+        // Frame the next anchors are rigidly attached to, and the transform
+        // from it to the end of the anchors seen so far
+        const Frame* host = linkage;
+        TRANSFORM offset = TRANSFORM::Identity();
+
+        for(size_t j=0; j<linkage->joints_.size(); j++)
+        {
+            Joint* joint = linkage->joints_[j];
+            if(joint->jointType_ != ANCHOR)
+            {
+                joint->respectToFixed_ = offset * joint->respectToFixed_;
+                kept.push_back(joint);
+                host = joint;
+                offset = TRANSFORM::Identity();
+                continue;
+            }
+
+            offset = offset * joint->respectToFixed_;
+            collapsedFrames_[joint->name()].host = host;
+            collapsedFrames_[joint->name()].offset = offset;
+
+            if(!kept.empty())
+                kept.back()->link.merge(joint->link, offset);
+            else if(linkage->hasParent)
+                linkage->parentLinkage_->tool_.massProperties.merge(joint->link, linkage->respectToFixed_*offset);
+            else
+                rootLink.merge(joint->link, linkage->respectToFixed_*offset);
+
+            removed++; // Its storage is released with the robot
+        }
+
+        linkage->tool_.respectToFixed_ = offset * linkage->tool_.respectToFixed_;
+        linkage->joints_ = kept;
+    }
+
+    if(removed == 0)
+        return 0;
+
+    // Renumber what is left
+    joints_.resize(0);
+    jointNameToIndex_.clear();
+    for(size_t l=0; l<linkages_.size(); l++)
+    {
+        Linkage* linkage = linkages_[l];
+        linkage->jointNameToIndex_.clear();
+        for(size_t j=0; j<linkage->joints_.size(); j++)
+        {
+            Joint* joint = linkage->joints_[j];
+            joint->localID_ = j;
+            joint->id_ = joints_.size();
+            linkage->jointNameToIndex_.insert(joint->name(), j);
+            jointNameToIndex_.insert(joint->name(), joints_.size());
+            joints_.push_back(joint);
+        }
+        linkage->markDirty();
+    }
+
+    layout_++;
+
+    return removed;
+}
+
+bool Robot::isCollapsed(string frameName) const
+{
+    return collapsedFrames_.find(frameName) != collapsedFrames_.end();
+}
+
+const CollapsedFrame& Robot::collapsedFrame(string frameName) const
+{
+    map<string,CollapsedFrame>::const_iterator f = collapsedFrames_.find(frameName);
+    if( f != collapsedFrames_.end() )
+        return f->second;
+
+    cerr << "Invalid collapsed frame name: (" << frameName << ")" << endl;
+    static const CollapsedFrame invalidFrame = { NULL, TRANSFORM::Identity() };
+    return invalidFrame;
+}
+
+TRANSFORM Robot::collapsedRespectTo(string frameName, const Frame* refFrame) const
+{
+    const CollapsedFrame& frame = collapsedFrame(frameName);
+    if(frame.host == NULL)
+        return respectTo(refFrame);
+    return frame.host->respectTo(refFrame) * frame.offset;
+}
+
 //------------------------------------------------------------------------------
 // Robot Protected Member Functions
 //------------------------------------------------------------------------------
+bool Robot::moves(const Joint& mover, const Joint& joint)
+{
+    const Linkage* a = mover.linkage_;
+    const Linkage* b = joint.linkage_;
+    if(!mover.hasLinkage || !joint.hasLinkage)
+        return false;
+    if(a == b)
+        return mover.localID_ <= joint.localID_;
+
+    // Every joint of an ancestor linkage comes before its tool
+    while(b->hasParent && b->depth_ > a->depth_)
+    {
+        b = b->parentLinkage_;
+        if(b == a)
+            return true;
+    }
+    return false;
+}
+
+void Robot::saveLinkage(RobotSnapshot& snapshot, size_t linkageIndex,
+                        size_t linkageRecord, size_t& jointRecord) const
+{
+    const Linkage* linkage = linkages_[linkageIndex];
+    RobotSnapshot::LinkageRecord& record = snapshot.linkages_[linkageRecord];
+    record.respectToRobot = linkage->respectToRobot_;
+    record.toolRespectToLinkage = linkage->tool_.respectToLinkage_;
+    record.linkage = linkageIndex;
+    record.needsUpdate = linkage->needsUpdate_;
+    record.needsBaseUpdate = linkage->needsBaseUpdate_;
+    record.firstDirtyJoint = linkage->firstDirtyJoint_;
+
+    for(size_t i=0; i<linkage->joints_.size(); i++, jointRecord++)
+    {
+        const Joint* joint = linkage->joints_[i];
+        RobotSnapshot::JointRecord& saved = snapshot.joints_[jointRecord];
+        saved.value = joint->value_;
+        saved.respectToFixedTransformed = joint->respectToFixedTransformed_;
+        saved.respectToLinkage = joint->respectToLinkage_;
+    }
+}
+
+void Robot::copyStructure(const Robot& robot)
+{
+    // Both arenas were sized for robot, so every linkage and joint lands in
+    // a single block. Cached frames and dirty flags are copied as they are.
+    linkages_.resize(robot.linkages_.size());
+    joints_.resize(robot.joints_.size());
+    for(size_t l=0; l<robot.linkages_.size(); l++)
+    {
+        const Linkage& source = *robot.linkages_[l];
+        Linkage* linkage = linkageArena_.create(Linkage());
+        linkages_[l] = linkage;
+
+        linkage->respectToFixed_ = source.respectToFixed_;
+        linkage->name_ = source.name_;
+        linkage->id_ = source.id_;
+        linkage->gravity_constant = source.gravity_constant;
+        linkage->robot_ = this;
+        linkage->hasRobot = true;
+        linkage->respectToWorldCache_ = source.respectToWorldCache_;
+        linkage->worldCacheValid_ = source.worldCacheValid_;
+
+        linkage->respectToRobot_ = source.respectToRobot_;
+        linkage->needsUpdate_ = source.needsUpdate_;
+        linkage->needsBaseUpdate_ = source.needsBaseUpdate_;
+        linkage->firstDirtyJoint_ = source.firstDirtyJoint_;
+        linkage->depth_ = source.depth_;
+        linkage->ownsJoints_ = false;
+        linkage->jointNameToIndex_ = source.jointNameToIndex_;
+        linkage->analyticalIK = source.analyticalIK;
+
+        // Parents come first, so they are already in place
+        if(source.hasParent)
+        {
+            linkage->parentLinkage_ = linkages_[source.parentLinkage_->id_];
+            linkage->hasParent = true;
+            linkage->parentLinkage_->childLinkages_.push_back(linkage);
+            linkage->parentLinkage_->hasChildren = true;
+        }
+
+        linkage->joints_.resize(source.joints_.size());
+        for(size_t j=0; j<source.joints_.size(); j++)
+        {
+            const Joint& sourceJoint = *source.joints_[j];
+            Joint* joint = jointArena_.create(sourceJoint);
+            joint->value_ = sourceJoint.value_;
+            joint->respectToFixedTransformed_ = sourceJoint.respectToFixedTransformed_;
+            joint->respectToLinkage_ = sourceJoint.respectToLinkage_;
+            joint->respectToWorldCache_ = sourceJoint.respectToWorldCache_;
+            joint->worldCacheValid_ = sourceJoint.worldCacheValid_;
+            joint->gravity_constant = sourceJoint.gravity_constant;
+            joint->localID_ = sourceJoint.localID_;
+            joint->linkage_ = linkage;
+            joint->hasLinkage = true;
+            joint->robot_ = this;
+            joint->hasRobot = true;
+
+            linkage->joints_[j] = joint;
+            joints_[sourceJoint.id_] = joint;
+        }
+
+        linkage->tool_ = source.tool_;
+        linkage->tool_.id_ = source.tool_.id_;
+        linkage->tool_.respectToWorldCache_ = source.tool_.respectToWorldCache_;
+        linkage->tool_.worldCacheValid_ = source.tool_.worldCacheValid_;
+        linkage->tool_.linkage_ = linkage;
+        linkage->tool_.hasLinkage = true;
+        linkage->tool_.robot_ = this;
+        linkage->tool_.hasRobot = true;
+    }
+
+    linkageNameToIndex_ = robot.linkageNameToIndex_;
+    jointNameToIndex_ = robot.jointNameToIndex_;
+
+    // Collapsed frames point into robot, so move them to the same frames
+    // of this robot
+    map<string,CollapsedFrame>::const_iterator f;
+    for(f = robot.collapsedFrames_.begin(); f != robot.collapsedFrames_.end(); ++f)
+    {
+        CollapsedFrame frame = f->second;
+        switch(frame.host->frameType())
+        {
+        case LINKAGE: frame.host = linkages_[frame.host->id_]; break;
+        case JOINT:   frame.host = joints_[frame.host->id_]; break;
+        case TOOL:    frame.host = &linkages_[frame.host->linkage_->id_]->tool_; break;
+        default:      frame.host = this; break;
+        }
+        collapsedFrames_[f->first] = frame;
+    }
+
+    respectToWorldCache_ = robot.respectToWorldCache_;
+    worldCacheValid_ = robot.worldCacheValid_;
+}
+
 void Robot::initialize(vector<Linkage> linkages, vector<int> parentIndices)
 {
     
@@ -379,20 +1302,41 @@ void Robot::initialize(vector<Linkage> linkages, vector<int> parentIndices)
         return;
     }
     
-    vector<indexParentIndexPair> iPI(linkages.size());
+    // Breadth first from the roots, so that parents get added before
+    // children however deep the tree is
+    vector< vector<size_t> > children(linkages.size());
+    vector<size_t> order;
     for (size_t i = 0; i != linkages.size(); ++i) {
-        iPI[i].I = i;
-        iPI[i].pI = parentIndices[i];
+        if(parentIndices[i] < 0)
+            order.push_back(i);
+        else if(parentIndices[i] < (int)linkages.size())
+            children[parentIndices[i]].push_back(i);
     }
-    sort(iPI.begin(), iPI.end());
-    // ^^^ Make sure that parents get added before children
+    for (size_t k = 0; k < order.size(); ++k)
+        order.insert(order.end(), children[order[k]].begin(), children[order[k]].end());
+
+    if(order.size() != linkages.size())
+    {
+        std::cerr << "ERROR! The parent indices do not describe a tree: "
+                  << linkages.size()-order.size() << " linkage(s) cannot be reached from a root!"
+                  << std::endl;
+        return;
+    }
+
+    // Parent indices refer to positions in linkages, not in the robot
+    vector<int> robotIndex(linkages.size());
+    for (size_t k = 0; k != order.size(); ++k)
+        robotIndex[order[k]] = (int)k;
     
     
     initializing_ = true;
 
 
-    for(size_t i = 0; i != linkages.size(); ++i)
-        addLinkage(linkages[iPI[i].I], parentIndices[iPI[i].I], linkages[iPI[i].I].name());
+    for(size_t k = 0; k != order.size(); ++k)
+    {
+        int parent = parentIndices[order[k]];
+        addLinkage(linkages[order[k]], parent < 0 ? -1 : robotIndex[parent], linkages[order[k]].name());
+    }
     
     initializing_ = false;
     
@@ -405,22 +1349,26 @@ void Robot::addLinkage(Linkage linkage, int parentIndex, string name)
     // Get the linkage adjusted to its new home
     size_t newIndex = linkages_.size();
 
-    Linkage* tempLinkage = new Linkage(linkage);
-    linkages_.push_back(tempLinkage);
-    
-    if(parentIndex == -1)
-        linkages_[newIndex]->parentLinkage_ = NULL;
-    else if( parentIndex > linkages_.size()-1 )
+    // Parents must already be in the robot, which keeps linkages_ in
+    // topological order
+    if( parentIndex >= (int)newIndex )
     {
         std::cerr << "ERROR! Parent index value (" << parentIndex << ") is larger "
-                  << "than the current highest linkage index (" << linkages().size()-1 << ")!"
+                  << "than the current highest linkage index (" << (int)newIndex-1 << ")!"
                   << std::endl;
         return;
     }
+
+    Linkage* tempLinkage = linkageArena_.create(linkage);
+    linkages_.push_back(tempLinkage);
+    
+    if(parentIndex < 0)
+        linkages_[newIndex]->parentLinkage_ = NULL;
     else
     {
         linkages_[newIndex]->parentLinkage_ = linkages_[parentIndex];
         linkages_[newIndex]->hasParent = true;
+        linkages_[newIndex]->depth_ = linkages_[parentIndex]->depth_ + 1;
         // TODO: Decide if this should be true for root linkage or not
     }
     
@@ -431,17 +1379,24 @@ void Robot::addLinkage(Linkage linkage, int parentIndex, string name)
     linkages_[newIndex]->hasRobot = true;
     linkages_[newIndex]->id_ = newIndex;
     linkages_[newIndex]->name_ = name;
-    // Move in its luggage
+    // Move in its luggage, from the heap into the joint arena
     for(size_t j = 0; j != linkages_[newIndex]->nJoints(); ++j)
     {
+        Joint* heapJoint = linkages_[newIndex]->joints_[j];
+        linkages_[newIndex]->joints_[j] = jointArena_.create(*heapJoint);
+        delete heapJoint;
+
+        linkages_[newIndex]->joints_[j]->localID_ = j;
         linkages_[newIndex]->joints_[j]->linkage_ = linkages_[newIndex];
         linkages_[newIndex]->joints_[j]->hasLinkage = true;
         linkages_[newIndex]->joints_[j]->robot_ = this;
         linkages_[newIndex]->joints_[j]->hasRobot = true;
         joints_.push_back(linkages_[newIndex]->joints_[j]);
         joints_.back()->id_ = joints_.size()-1;
-        jointNameToIndex_[joints_.back()->name()] = joints_.size()-1;
+        jointNameToIndex_.insert(joints_.back()->name(), joints_.size()-1);
     }
+    linkages_[newIndex]->ownsJoints_ = false;
+    linkages_[newIndex]->markDirty();
     // TODO: Allow for multiple tools maybe?
     linkages_[newIndex]->tool_.linkage_ = linkages_[newIndex];
     linkages_[newIndex]->tool_.hasLinkage = true;
@@ -450,7 +1405,8 @@ void Robot::addLinkage(Linkage linkage, int parentIndex, string name)
     linkages_[newIndex]->tool_.id_ = newIndex;
     
     // Tell the post office we've moved in
-    linkageNameToIndex_[linkages_[newIndex]->name_] = newIndex;
+    linkageNameToIndex_.insert(linkages_[newIndex]->name_, newIndex);
+    layout_++;
     
     // Inform the parent of its pregnancy
     if(linkages_[newIndex]->parentLinkage_ != NULL)
@@ -471,24 +1427,64 @@ void Robot::addLinkage(int parentIndex, string name)
 //------------------------------------------------------------------------------
 void Robot::updateFrames()
 {
-
+    // Frames are normally brought up to date lazily when they are queried.
+    // This forces every stale frame to be recomputed right away, e.g. before
+    // handing the robot to code that only reads it. linkages_ is in
+    // topological order, so a single sweep composes each linkage once.
     for (vector<Linkage*>::iterator linkageIt = linkages_.begin();
          linkageIt != linkages_.end(); ++linkageIt) {
 
+        if((*linkageIt)->needsBaseUpdate_)
+            (*linkageIt)->composeBase();
+
         if((*linkageIt)->needsUpdate_)
             (*linkageIt)->updateFrames();
-        
-        // TODO: Consider using if((*linkageIt)->hasParent_) instead to avoid use of pointers
-        if ((*linkageIt)->parentLinkage_ == 0)
-//        {
-            (*linkageIt)->respectToRobot_ = (*linkageIt)->respectToFixed_;
-//        } else {
-//            (*linkageIt)->respectToRobot_ = (*linkageIt)->parentLinkage_->tool_.respectToRobot() * (*linkageIt)->respectToFixed_;
-//        }
     }
 
 }
 
 
 
+//------------------------------------------------------------------------------
+// RobotKinematicState Lifecycle
+//------------------------------------------------------------------------------
+RobotKinematicState::RobotKinematicState(Robot& robot)
+    : robot_(robot)
+{
+
+}
+
+
+//------------------------------------------------------------------------------
+// RobotKinematicState Public Member Functions
+//------------------------------------------------------------------------------
+double RobotKinematicState::min(size_t jointIndex) const { return robot_.const_joint(jointIndex).min(); }
+double RobotKinematicState::max(size_t jointIndex) const { return robot_.const_joint(jointIndex).max(); }
+JointType RobotKinematicState::jointType(size_t jointIndex) const { return robot_.const_joint(jointIndex).getJointType(); }
+
+double RobotKinematicState::value(size_t jointIndex) const { return robot_.const_joint(jointIndex).value(); }
+
+void RobotKinematicState::values(const vector<size_t>& jointIndices, const VectorXd& jointValues)
+{
+    robot_.values(jointIndices, jointValues);
+}
+
+TRANSFORM RobotKinematicState::jointRespectToRobot(size_t jointIndex) const
+{
+    return robot_.const_joint(jointIndex).respectToRobot();
+}
+
+void RobotKinematicState::jacobian(MatrixXd& J, const vector<size_t>& jointIndices, const TRANSLATION& location)
+{
+    joints_.resize(jointIndices.size());
+    for(size_t i=0; i<jointIndices.size(); i++)
+        joints_[i] = &robot_.joint(jointIndices[i]);
+
+    robot_.jacobian(J, joints_, location, &robot_);
+}
+
+bool RobotKinematicState::getImposeLimits() const { return robot_.imposeLimits; }
+void RobotKinematicState::setImposeLimits(bool imposeLimits) { robot_.imposeLimits = imposeLimits; }
+bool RobotKinematicState::verbose() const { return robot_.verbose; }
 
+Robot* RobotKinematicState::robot() { return &robot_; }
@@ -0,0 +1,321 @@
+/*
+ -------------------------------------------------------------------------------
+ RobotModel.cpp
+ Robot Library Project
+
+ Version 1.0
+ -------------------------------------------------------------------------------
+ */
+
+
+
+//------------------------------------------------------------------------------
+// Includes
+//------------------------------------------------------------------------------
+#include "RobotModel.h"
+#include "Robot.h"
+
+
+//------------------------------------------------------------------------------
+// Namespaces
+//------------------------------------------------------------------------------
+using namespace std;
+using namespace Eigen;
+using namespace RobotKin;
+
+
+//------------------------------------------------------------------------------
+// RobotModel Lifecycle
+//------------------------------------------------------------------------------
+RobotModel::RobotModel()
+    : respectToWorld_(TRANSFORM::Identity())
+{
+
+}
+
+RobotModel::RobotModel(const Robot& robot)
+    : respectToWorld_(TRANSFORM::Identity())
+{
+    build(robot);
+}
+
+RobotModel::RobotModel(string filename)
+    : respectToWorld_(TRANSFORM::Identity())
+{
+    Robot robot(filename);
+    build(robot);
+}
+
+void RobotModel::build(const Robot& robot)
+{
+    name_ = robot.name();
+    kinematics_.compile(robot);
+    respectToWorld_ = robot.respectToWorld();
+    rootLink_ = robot.rootLink;
+
+    jointNames_.resize(robot.nJoints());
+    jointNameToIndex_.clear();
+    for(size_t i=0; i<robot.nJoints(); i++)
+    {
+        jointNames_[i] = robot.const_joint(i).name();
+        jointNameToIndex_.insert(jointNames_[i], i);
+    }
+
+    const vector<Linkage*>& linkages = robot.const_linkages();
+    linkageNames_.resize(linkages.size());
+    linkageJoints_.resize(linkages.size());
+    linkageNameToIndex_.clear();
+    links_.assign(kinematics_.nFrames(), Link());
+    for(size_t l=0; l<linkages.size(); l++)
+    {
+        linkageNames_[l] = linkages[l]->name();
+        linkageNameToIndex_.insert(linkageNames_[l], l);
+
+        linkageJoints_[l].resize(linkages[l]->nJoints());
+        for(size_t j=0; j<linkages[l]->nJoints(); j++)
+        {
+            const Joint& joint = linkages[l]->const_joint(j);
+            linkageJoints_[l][j] = joint.id();
+            links_[kinematics_.jointFrame(joint.id())] = joint.link;
+        }
+
+        links_[kinematics_.toolFrame(l)] = linkages[l]->const_tool().massProperties;
+    }
+}
+
+
+//------------------------------------------------------------------------------
+// RobotModel Public Member Functions
+//------------------------------------------------------------------------------
+string RobotModel::name() const { return name_; }
+
+size_t RobotModel::nJoints() const { return jointNames_.size(); }
+size_t RobotModel::nLinkages() const { return linkageNames_.size(); }
+
+size_t RobotModel::jointIndex(string jointName) const
+{
+    size_t j = jointNameToIndex_.find(jointName);
+    if( j != NameTable::npos )
+        return j;
+
+    return nJoints();
+}
+
+size_t RobotModel::linkageIndex(string linkageName) const
+{
+    size_t l = linkageNameToIndex_.find(linkageName);
+    if( l != NameTable::npos )
+        return l;
+
+    return nLinkages();
+}
+
+const string& RobotModel::jointName(size_t jointIndex) const { return jointNames_[jointIndex]; }
+const string& RobotModel::linkageName(size_t linkageIndex) const { return linkageNames_[linkageIndex]; }
+
+rk_result_t RobotModel::jointNamesToIndices(const vector<string> &jointNames, vector<size_t> &jointIndices) const
+{
+    jointIndices.resize(jointNames.size());
+    for(size_t i=0; i<jointNames.size(); i++)
+    {
+        jointIndices[i] = jointIndex(jointNames[i]);
+        if( jointIndices[i] == nJoints() )
+            return RK_INVALID_JOINT;
+    }
+
+    return RK_SOLVED;
+}
+
+const vector<size_t>& RobotModel::linkageJoints(size_t linkageIndex) const
+{
+    return linkageJoints_[linkageIndex];
+}
+
+double RobotModel::min(size_t jointIndex) const
+{
+    return kinematics_.min(kinematics_.jointFrame(jointIndex));
+}
+
+double RobotModel::max(size_t jointIndex) const
+{
+    return kinematics_.max(kinematics_.jointFrame(jointIndex));
+}
+
+JointType RobotModel::jointType(size_t jointIndex) const
+{
+    return kinematics_.jointType(kinematics_.jointFrame(jointIndex));
+}
+
+const Link& RobotModel::link(size_t frame) const { return links_[frame]; }
+const Link& RobotModel::rootLink() const { return rootLink_; }
+
+const TRANSFORM& RobotModel::respectToWorld() const { return respectToWorld_; }
+const CompiledKinematics& RobotModel::kinematics() const { return kinematics_; }
+
+void RobotModel::jacobian(MatrixXd& J, const RobotState& state,
+                          const vector<size_t>& jointIndices, const TRANSLATION& location) const
+{
+    J.resize(6, jointIndices.size());
+
+    for(size_t i=0; i<jointIndices.size(); i++)
+    {
+        size_t frame = kinematics_.jointFrame(jointIndices[i]);
+        const TRANSFORM& pose = state.frames()[frame];
+        AXIS z = pose.rotation()*kinematics_.axis(frame);
+
+        if(kinematics_.jointType(frame) == REVOLUTE)
+        {
+            J.block(0,i,3,1) = z.cross(location - pose.translation());
+            J.block(3,i,3,1) = z;
+        }
+        else if(kinematics_.jointType(frame) == PRISMATIC)
+        {
+            J.block(0,i,3,1) = z;
+            J.block(3,i,3,1).setZero();
+        }
+        else
+            J.col(i).setZero();
+    }
+}
+
+
+//------------------------------------------------------------------------------
+// RobotState Lifecycle
+//------------------------------------------------------------------------------
+RobotState::RobotState(const RobotModel& model)
+    : imposeLimits(true),
+      model_(&model),
+      values_(VectorXd::Zero(model.nJoints())),
+      needsUpdate_(true)
+{
+
+}
+
+
+//------------------------------------------------------------------------------
+// RobotState Public Member Functions
+//------------------------------------------------------------------------------
+const RobotModel& RobotState::model() const { return *model_; }
+size_t RobotState::nJoints() const { return values_.size(); }
+
+double RobotState::value(size_t jointIndex) const { return values_[jointIndex]; }
+
+rk_result_t RobotState::value(size_t jointIndex, double newValue)
+{
+    rk_result_t result = RK_SOLVED;
+
+    if(imposeLimits)
+    {
+        if(newValue < model_->min(jointIndex))
+        {
+            newValue = model_->min(jointIndex);
+            result = RK_HIT_LOWER_LIMIT;
+        }
+        else if(newValue > model_->max(jointIndex))
+        {
+            newValue = model_->max(jointIndex);
+            result = RK_HIT_UPPER_LIMIT;
+        }
+    }
+
+    values_[jointIndex] = newValue;
+    needsUpdate_ = true;
+
+    return result;
+}
+
+const VectorXd& RobotState::values() const { return values_; }
+
+void RobotState::values(const VectorXd& allValues)
+{
+    if( (size_t)allValues.size() != nJoints() )
+    {
+        cerr << "Invalid number of joint values: " << allValues.size()
+             << "\n\t This should be equal to " << nJoints() << endl;
+        return;
+    }
+
+    for(size_t i=0; i<nJoints(); i++)
+        value(i, allValues[i]);
+}
+
+void RobotState::values(const vector<size_t>& jointIndices, const VectorXd& jointValues)
+{
+    if( jointIndices.size() != (size_t)jointValues.size() )
+    {
+        cerr << "Invalid number of joint values: " << jointValues.size()
+             << "\n\t This should be equal to " << jointIndices.size() << endl;
+        return;
+    }
+
+    for(size_t i=0; i<jointIndices.size(); i++)
+        value(jointIndices[i], jointValues[i]);
+}
+
+const TRANSFORM& RobotState::jointRespectToRobot(size_t jointIndex) const
+{
+    return frames()[model_->kinematics().jointFrame(jointIndex)];
+}
+
+const TRANSFORM& RobotState::toolRespectToRobot(size_t linkageIndex) const
+{
+    return frames()[model_->kinematics().toolFrame(linkageIndex)];
+}
+
+const TRANSFORM& RobotState::linkageRespectToRobot(size_t linkageIndex) const
+{
+    return frames()[model_->kinematics().linkageFrame(linkageIndex)];
+}
+
+const vector<TRANSFORM>& RobotState::frames() const
+{
+    if(needsUpdate_)
+        updateFrames();
+    return frames_;
+}
+
+void RobotState::updateFrames() const
+{
+    model_->kinematics().forwardKinematics(values_, frames_);
+    needsUpdate_ = false;
+}
+
+
+//------------------------------------------------------------------------------
+// ModelKinematicState Lifecycle
+//------------------------------------------------------------------------------
+ModelKinematicState::ModelKinematicState(RobotState& state)
+    : state_(state)
+{
+
+}
+
+
+//------------------------------------------------------------------------------
+// ModelKinematicState Public Member Functions
+//------------------------------------------------------------------------------
+double ModelKinematicState::min(size_t jointIndex) const { return state_.model().min(jointIndex); }
+double ModelKinematicState::max(size_t jointIndex) const { return state_.model().max(jointIndex); }
+JointType ModelKinematicState::jointType(size_t jointIndex) const { return state_.model().jointType(jointIndex); }
+
+double ModelKinematicState::value(size_t jointIndex) const { return state_.value(jointIndex); }
+
+void ModelKinematicState::values(const vector<size_t>& jointIndices, const VectorXd& jointValues)
+{
+    state_.values(jointIndices, jointValues);
+}
+
+TRANSFORM ModelKinematicState::jointRespectToRobot(size_t jointIndex) const
+{
+    return state_.jointRespectToRobot(jointIndex);
+}
+
+void ModelKinematicState::jacobian(MatrixXd& J, const vector<size_t>& jointIndices, const TRANSLATION& location)
+{
+    state_.model().jacobian(J, state_, jointIndices, location);
+}
+
+bool ModelKinematicState::getImposeLimits() const { return state_.imposeLimits; }
+void ModelKinematicState::setImposeLimits(bool imposeLimits) { state_.imposeLimits = imposeLimits; }
+
+RobotState* ModelKinematicState::robotState() { return &state_; }
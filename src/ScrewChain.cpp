@@ -0,0 +1,210 @@
+/*
+ -------------------------------------------------------------------------------
+ ScrewChain.cpp
+ Robot Library Project
+
+ Version 1.0
+ -------------------------------------------------------------------------------
+ */
+
+
+
+//------------------------------------------------------------------------------
+// Includes
+//------------------------------------------------------------------------------
+#include "ScrewChain.h"
+#include "CompiledKinematics.h"
+#include "Robot.h"
+
+
+//------------------------------------------------------------------------------
+// Namespaces
+//------------------------------------------------------------------------------
+using namespace std;
+using namespace Eigen;
+using namespace RobotKin;
+
+
+//------------------------------------------------------------------------------
+// ScrewChain Lifecycle
+//------------------------------------------------------------------------------
+ScrewChain::ScrewChain()
+    : home_(RigidTransform::Identity())
+{
+
+}
+
+ScrewChain::ScrewChain(const Linkage& linkage)
+    : home_(RigidTransform::Identity())
+{
+    vector<size_t> jointIndices(linkage.nJoints());
+    for(size_t i=0; i<jointIndices.size(); i++)
+        jointIndices[i] = i;
+
+    TRANSFORM finalTransform = linkage.const_tool().respectToFixed();
+    if(linkage.nJoints() == 0)
+        finalTransform = TRANSFORM::Identity();
+
+    build(CompiledKinematics(linkage), VectorXd::Zero(linkage.nJoints()), jointIndices, finalTransform);
+}
+
+ScrewChain::ScrewChain(const Robot& robot, const vector<size_t>& jointIndices,
+                       const TRANSFORM& finalTransform)
+    : home_(RigidTransform::Identity())
+{
+    build(CompiledKinematics(robot), robot.values(), jointIndices, finalTransform);
+}
+
+bool ScrewChain::build(const CompiledKinematics& kinematics, const VectorXd& values,
+                       const vector<size_t>& jointIndices, const TRANSFORM& finalTransform)
+{
+    screws_.resize(6, 0);
+    jointIndices_.resize(0);
+    home_ = RigidTransform(finalTransform);
+
+    if((size_t)values.size() != kinematics.nJoints())
+    {
+        cerr << "Invalid number of joint values: " << values.size()
+             << "\n\t This should be equal to " << kinematics.nJoints() << endl;
+        return false;
+    }
+
+    VectorXd q(values);
+    for(size_t i=0; i<jointIndices.size(); i++)
+    {
+        if(jointIndices[i] >= kinematics.nJoints())
+        {
+            cerr << "Invalid joint index: " << jointIndices[i] << endl;
+            return false;
+        }
+        q[jointIndices[i]] = 0;
+    }
+
+    vector<TRANSFORM> frames;
+    kinematics.forwardKinematics(q, frames);
+
+    screws_.resize(6, jointIndices.size());
+    for(size_t i=0; i<jointIndices.size(); i++)
+    {
+        size_t frame = kinematics.jointFrame(jointIndices[i]);
+        AXIS z = frames[frame].rotation()*kinematics.axis(frame);
+
+        if(kinematics.jointType(frame) == REVOLUTE)
+        {
+            // A pure rotation about the line through the joint origin
+            screws_.block<3,1>(0,i) = frames[frame].translation().cross(z);
+            screws_.block<3,1>(3,i) = z;
+        }
+        else if(kinematics.jointType(frame) == PRISMATIC)
+        {
+            screws_.block<3,1>(0,i) = z;
+            screws_.block<3,1>(3,i).setZero();
+        }
+        else
+            screws_.col(i).setZero();
+    }
+
+    jointIndices_ = jointIndices;
+    if(!jointIndices.empty())
+        home_ = RigidTransform(frames[kinematics.jointFrame(jointIndices.back())]*finalTransform);
+
+    return true;
+}
+
+
+//------------------------------------------------------------------------------
+// ScrewChain Public Member Functions
+//------------------------------------------------------------------------------
+size_t ScrewChain::nJoints() const { return jointIndices_.size(); }
+size_t ScrewChain::jointIndex(size_t i) const { return jointIndices_[i]; }
+SCREW ScrewChain::spaceScrew(size_t i) const { return screws_.col(i); }
+TRANSFORM ScrewChain::home() const { return home_.toIsometry(); }
+
+void ScrewChain::forwardKinematics(const VectorXd& q, TRANSFORM& pose) const
+{
+    pose = sweep(q, NULL).toIsometry();
+}
+
+void ScrewChain::spaceJacobian(const VectorXd& q, Matrix6Xd& J, TRANSFORM& pose) const
+{
+    pose = sweep(q, &J).toIsometry();
+}
+
+void ScrewChain::bodyJacobian(const VectorXd& q, Matrix6Xd& J, TRANSFORM& pose) const
+{
+    RigidTransform T = sweep(q, &J);
+    pose = T.toIsometry();
+
+    // J_b = Ad(T^-1) J_s
+    for(int i=0; i<J.cols(); i++)
+    {
+        Vector3d v = J.block<3,1>(0,i) - T.translation().cross(J.block<3,1>(3,i));
+        J.block<3,1>(0,i) = T.rotation().transpose()*v;
+        J.block<3,1>(3,i) = T.rotation().transpose()*J.block<3,1>(3,i);
+    }
+}
+
+void ScrewChain::jacobian(const VectorXd& q, Matrix6Xd& J, TRANSFORM& pose) const
+{
+    RigidTransform T = sweep(q, &J);
+    pose = T.toIsometry();
+
+    // The linear part of a space twist is the velocity of the point at the
+    // base origin, so shift it to the end effector
+    for(int i=0; i<J.cols(); i++)
+        J.block<3,1>(0,i) += J.block<3,1>(3,i).cross(T.translation());
+}
+
+RigidTransform ScrewChain::exponential(const SCREW& screw, double theta)
+{
+    Vector3d w = screw.tail<3>();
+    Vector3d v = screw.head<3>();
+
+    if(w.isZero())
+        return RigidTransform(Matrix3d::Identity(), v*theta);
+
+    double c = cos(theta), s = sin(theta);
+    Vector3d wv = w.cross(v);
+
+    return RigidTransform(AngleAxisd(theta, w).toRotationMatrix(),
+                          theta*v + (1-c)*wv + (theta-s)*w.cross(wv));
+}
+
+SCREW ScrewChain::adjoint(const RigidTransform& T, const SCREW& twist)
+{
+    SCREW result;
+    result.tail<3>() = T.rotation()*twist.tail<3>();
+    result.head<3>() = T.rotation()*twist.head<3>() + T.translation().cross(result.tail<3>());
+    return result;
+}
+
+
+//------------------------------------------------------------------------------
+// ScrewChain Protected Member Functions
+//------------------------------------------------------------------------------
+RigidTransform ScrewChain::sweep(const VectorXd& q, Matrix6Xd* J) const
+{
+    if(J != NULL)
+        J->resize(6, nJoints());
+
+    if((size_t)q.size() != nJoints())
+    {
+        cerr << "Invalid number of joint values: " << q.size()
+             << "\n\t This should be equal to " << nJoints() << endl;
+        if(J != NULL)
+            J->setZero();
+        return home_;
+    }
+
+    // Product of the exponentials of the joints before joint i
+    RigidTransform T(RigidTransform::Identity());
+    for(size_t i=0; i<nJoints(); i++)
+    {
+        SCREW screw = screws_.col(i);
+        if(J != NULL)
+            J->col(i) = adjoint(T, screw);
+        T *= exponential(screw, q[i]);
+    }
+
+    return T*home_;
+}
@@ -1,5 +1,6 @@
 
 #include "Robot.h"
+#include "RobotModel.h"
 #include <eigen3/Eigen/SVD>
 #include <eigen3/Eigen/QR>
 
@@ -61,38 +62,25 @@ double RobotKin::minimum(double a, double b) { return a<b ? a : b; }
 
 void RobotKin::wrapToJointLimits(Robot& robot, const vector<size_t>& jointIndices, VectorXd& jointValues)
 {
-    for(int i=0; i<jointIndices.size(); i++)
+    RobotKinematicState state(robot);
+    wrapToJointLimits(state, jointIndices, jointValues);
+}
+
+void RobotKin::wrapToJointLimits(const KinematicState& state, const vector<size_t>& jointIndices, VectorXd& jointValues)
+{
+    for(size_t i=0; i<jointIndices.size(); i++)
     {
-        if(robot.joint(jointIndices[i]).getJointType()==RobotKin::REVOLUTE)
+        if(state.jointType(jointIndices[i]) != REVOLUTE)
+            continue;
+
+        double lower = state.min(jointIndices[i]);
+        double upper = state.max(jointIndices[i]);
+        if( !(lower <= jointValues[i] && jointValues[i] <= upper) )
         {
-            if( !(robot.joint(jointIndices[i]).min() <= jointValues[i]
-                    && jointValues[i] <= robot.joint(jointIndices[i]).max()) )
-            {
-//                double tempValue = jointValues[i];
-//                while(tempValue > robot.joint(jointIndices[i]).max())
-//                    tempValue -= 2*M_PI;
-
-//                while(tempValue < robot.joint(jointIndices[i]).min())
-//                    tempValue += 2*M_PI;
-
-//                if(robot.joint(jointIndices[i]).min() <= tempValue
-//                        && tempValue <= robot.joint(jointIndices[i]).max())
-//                    jointValues[i] = tempValue;
-//                else
-//                {
-//                    if( fabs(wrapToPi(jointValues[i]-robot.joint(jointIndices[i]).min())) <
-//                            fabs(wrapToPi(jointValues[i]-robot.joint(jointIndices[i]).max())) )
-//                        jointValues[i] = robot.joint(jointIndices[i]).min();
-//                    else
-//                        jointValues[i] = robot.joint(jointIndices[i]).max();
-//                }
-                
-                if( fabs(wrapToPi(jointValues[i]-robot.joint(jointIndices[i]).min())) <
-                        fabs(wrapToPi(jointValues[i]-robot.joint(jointIndices[i]).max())) )
-                    jointValues[i] = robot.joint(jointIndices[i]).min();
-                else
-                    jointValues[i] = robot.joint(jointIndices[i]).max();
-            }
+            if( fabs(wrapToPi(jointValues[i]-lower)) < fabs(wrapToPi(jointValues[i]-upper)) )
+                jointValues[i] = lower;
+            else
+                jointValues[i] = upper;
         }
     }
 }
@@ -295,6 +283,28 @@ double Robot::mass(const std::vector<std::string> &names, FrameType typeOfIndex)
     return mass(indices, typeOfIndex);
 }
 
+TRANSLATION Robot::centerOfMass(const JointGroupHandle& group, FrameType withRespectTo)
+{
+    if(!isValid(group))
+    {
+        cerr << "Invalid joint group handle" << endl;
+        return TRANSLATION::Zero();
+    }
+
+    return centerOfMass(group.indices, JOINT, withRespectTo);
+}
+
+double Robot::mass(const JointGroupHandle& group)
+{
+    if(!isValid(group))
+    {
+        cerr << "Invalid joint group handle" << endl;
+        return 0;
+    }
+
+    return mass(group.indices, JOINT);
+}
+
 double Robot::mass()
 {
     double result = 0;
@@ -305,6 +315,84 @@ double Robot::mass()
     return result;
 }
 
+void Robot::centerOfMassJacobian(MatrixXd& J, const vector<size_t>& jointIndices, const Frame* refFrame) const
+{
+    for(size_t i=0; i<jointIndices.size(); i++)
+    {
+        if(jointIndices[i] >= nJoints())
+        {
+            cerr << "Invalid joint index: " << jointIndices[i] << endl;
+            return;
+        }
+    }
+
+    // Mass and first moment (mass times center of mass, with respect to the
+    // robot) of everything downstream of each joint, summed children first:
+    // linkages_ lists parents before children and joints in chain order
+    vector<double> downstreamMass(nJoints());
+    Matrix3Xd downstreamMoment(3, nJoints());
+    vector<double> childMass(linkages_.size(), 0.0);
+    Matrix3Xd childMoment = Matrix3Xd::Zero(3, linkages_.size());
+
+    double totalMass = rootLink.mass();
+    for(size_t l=linkages_.size(); l-- > 0; )
+    {
+        const Linkage* linkage = linkages_[l];
+        const Tool& tool = linkage->tool_;
+
+        double m = childMass[l] + tool.massProperties.mass();
+        TRANSLATION moment = childMoment.col(l)
+                + tool.massProperties.mass()*(tool.respectToRobot()*tool.massProperties.const_com());
+
+        for(size_t i=linkage->joints_.size(); i-- > 0; )
+        {
+            const Joint* joint = linkage->joints_[i];
+            m += joint->link.mass();
+            moment += joint->link.mass()*(joint->respectToRobot()*joint->link.const_com());
+            downstreamMass[joint->id_] = m;
+            downstreamMoment.col(joint->id_) = moment;
+        }
+
+        if(linkage->hasParent)
+        {
+            childMass[linkage->parentLinkage_->id_] += m;
+            childMoment.col(linkage->parentLinkage_->id_) += moment;
+        }
+        else
+            totalMass += m;
+    }
+
+    J.setZero(3, jointIndices.size());
+    if(totalMass <= 0)
+        return;
+
+    // Moving joint i carries its downstream mass along as a rigid body
+    for(size_t i=0; i<jointIndices.size(); i++)
+    {
+        size_t k = jointIndices[i];
+        const Joint* joint = joints_[k];
+        TRANSFORM pose = joint->respectToRobot();
+        AXIS z = pose.linear()*joint->jointAxis_;
+
+        if(joint->jointType_ == REVOLUTE)
+            J.col(i) = z.cross(downstreamMoment.col(k) - downstreamMass[k]*pose.translation());
+        else if(joint->jointType_ == PRISMATIC)
+            J.col(i) = downstreamMass[k]*z;
+    }
+    J /= totalMass;
+
+    if(refFrame != this)
+        J = refFrame->respectToWorld().linear().transpose() * respectToWorld_.linear() * J;
+}
+
+void Robot::centerOfMassJacobian(MatrixXd& J, const Frame* refFrame) const
+{
+    vector<size_t> jointIndices(nJoints());
+    for(size_t i=0; i<jointIndices.size(); i++)
+        jointIndices[i] = i;
+    centerOfMassJacobian(J, jointIndices, refFrame);
+}
+
 TRANSLATION Linkage::centerOfMass(FrameType withRespectTo)
 {
     TRANSLATION com; com.setZero();
@@ -737,13 +825,12 @@ rk_result_t Robot::selectivelyDampedLeastSquaresIK_chain(const vector<string> &j
     // TODO: Make the conversion from vector<string> to vector<size_t> its own function
     vector<size_t> jointIndices;
     jointIndices.resize(jointNames.size());
-    map<string,size_t>::iterator j;
     for(int i=0; i<jointNames.size(); i++)
     {
-        j = jointNameToIndex_.find(jointNames[i]);
-        if( j == jointNameToIndex_.end() )
+        size_t j = jointNameToIndex_.find(jointNames[i]);
+        if( j == NameTable::npos )
             return RK_INVALID_JOINT;
-        jointIndices[i] = j->second;
+        jointIndices[i] = j;
     }
 
     return selectivelyDampedLeastSquaresIK_chain(jointIndices, jointValues, target);
@@ -753,15 +840,26 @@ rk_result_t Robot::selectivelyDampedLeastSquaresIK_chain(const vector<string> &j
 rk_result_t Robot::selectivelyDampedLeastSquaresIK_linkage(const string linkageName, VectorXd &jointValues,
                                                 const TRANSFORM &target, const TRANSFORM &finalTF)
 {
-    vector<size_t> jointIndices;
-    jointIndices.resize(linkage(linkageName).joints_.size());
-    for(size_t i=0; i<linkage(linkageName).joints_.size(); i++)
-        jointIndices[i] = linkage(linkageName).joints_[i]->id();
+    LinkageHandle handle = linkageHandle(linkageName);
+    if(!isValid(handle))
+        return RK_INVALID_LINKAGE;
+
+    return selectivelyDampedLeastSquaresIK(jointGroupHandle(handle), jointValues, target, finalTF);
+}
+
+rk_result_t Robot::selectivelyDampedLeastSquaresIK(const JointGroupHandle& group, VectorXd &jointValues,
+                                                   const TRANSFORM &target, const TRANSFORM &finalTF)
+{
+    if(!isValid(group))
+        return group.linkage < 0 ? RK_INVALID_JOINT : RK_INVALID_LINKAGE;
+
+    if(group.linkage < 0)
+        return selectivelyDampedLeastSquaresIK_chain(group.indices, jointValues, target, finalTF);
 
     TRANSFORM linkageFinalTF;
-    linkageFinalTF = linkage(linkageName).tool().respectToFixed()*finalTF;
+    linkageFinalTF = linkages_[group.linkage]->tool().respectToFixed()*finalTF;
 
-    return selectivelyDampedLeastSquaresIK_chain(jointIndices, jointValues, target, linkageFinalTF);
+    return selectivelyDampedLeastSquaresIK_chain(group.indices, jointValues, target, linkageFinalTF);
 }
 
 
@@ -845,13 +943,12 @@ rk_result_t Robot::pseudoinverseIK_chain(const vector<string> &jointNames, Vecto
     // TODO: Make the conversion from vector<string> to vector<size_t> its own function
     vector<size_t> jointIndices;
     jointIndices.resize(jointNames.size());
-    map<string,size_t>::iterator j;
     for(int i=0; i<jointNames.size(); i++)
     {
-        j = jointNameToIndex_.find(jointNames[i]);
-        if( j == jointNameToIndex_.end() )
+        size_t j = jointNameToIndex_.find(jointNames[i]);
+        if( j == NameTable::npos )
             return RK_INVALID_JOINT;
-        jointIndices[i] = j->second;
+        jointIndices[i] = j;
     }
 
     return pseudoinverseIK_chain(jointIndices, jointValues, target);
@@ -861,15 +958,26 @@ rk_result_t Robot::pseudoinverseIK_chain(const vector<string> &jointNames, Vecto
 rk_result_t Robot::pseudoinverseIK_linkage(const string linkageName, VectorXd &jointValues,
                                                 const TRANSFORM &target, const TRANSFORM &finalTF)
 {
-    vector<size_t> jointIndices;
-    jointIndices.resize(linkage(linkageName).joints_.size());
-    for(size_t i=0; i<linkage(linkageName).joints_.size(); i++)
-        jointIndices[i] = linkage(linkageName).joints_[i]->id();
+    LinkageHandle handle = linkageHandle(linkageName);
+    if(!isValid(handle))
+        return RK_INVALID_LINKAGE;
+
+    return pseudoinverseIK(jointGroupHandle(handle), jointValues, target, finalTF);
+}
+
+rk_result_t Robot::pseudoinverseIK(const JointGroupHandle& group, VectorXd &jointValues,
+                                   const TRANSFORM &target, const TRANSFORM &finalTF)
+{
+    if(!isValid(group))
+        return group.linkage < 0 ? RK_INVALID_JOINT : RK_INVALID_LINKAGE;
+
+    if(group.linkage < 0)
+        return pseudoinverseIK_chain(group.indices, jointValues, target, finalTF);
 
     TRANSFORM linkageFinalTF;
-    linkageFinalTF = linkage(linkageName).tool().respectToFixed()*finalTF;
+    linkageFinalTF = linkages_[group.linkage]->tool().respectToFixed()*finalTF;
 
-    return pseudoinverseIK_chain(jointIndices, jointValues, target, linkageFinalTF);
+    return pseudoinverseIK_chain(group.indices, jointValues, target, linkageFinalTF);
 }
 
 
@@ -942,13 +1050,12 @@ rk_result_t Robot::jacobianTransposeIK_chain(const vector<string> &jointNames, V
     // TODO: Make the conversion from vector<string> to vector<size_t> its own function
     vector<size_t> jointIndices;
     jointIndices.resize(jointNames.size());
-    map<string,size_t>::iterator j;
     for(int i=0; i<jointNames.size(); i++)
     {
-        j = jointNameToIndex_.find(jointNames[i]);
-        if( j == jointNameToIndex_.end() )
+        size_t j = jointNameToIndex_.find(jointNames[i]);
+        if( j == NameTable::npos )
             return RK_INVALID_JOINT;
-        jointIndices[i] = j->second;
+        jointIndices[i] = j;
     }
 
     return jacobianTransposeIK_chain(jointIndices, jointValues, target);
@@ -958,49 +1065,61 @@ rk_result_t Robot::jacobianTransposeIK_chain(const vector<string> &jointNames, V
 rk_result_t Robot::jacobianTransposeIK_linkage(const string linkageName, VectorXd &jointValues,
                                                 const TRANSFORM &target, const TRANSFORM &finalTF)
 {
-    vector<size_t> jointIndices;
-    jointIndices.resize(linkage(linkageName).joints_.size());
-    for(size_t i=0; i<linkage(linkageName).joints_.size(); i++)
-        jointIndices[i] = linkage(linkageName).joints_[i]->id();
+    LinkageHandle handle = linkageHandle(linkageName);
+    if(!isValid(handle))
+        return RK_INVALID_LINKAGE;
+
+    return jacobianTransposeIK(jointGroupHandle(handle), jointValues, target, finalTF);
+}
+
+rk_result_t Robot::jacobianTransposeIK(const JointGroupHandle& group, VectorXd &jointValues,
+                                       const TRANSFORM &target, const TRANSFORM &finalTF)
+{
+    if(!isValid(group))
+        return group.linkage < 0 ? RK_INVALID_JOINT : RK_INVALID_LINKAGE;
+
+    if(group.linkage < 0)
+        return jacobianTransposeIK_chain(group.indices, jointValues, target, finalTF);
 
     TRANSFORM linkageFinalTF;
-    linkageFinalTF = linkage(linkageName).tool().respectToFixed()*finalTF;
+    linkageFinalTF = linkages_[group.linkage]->tool().respectToFixed()*finalTF;
 
-    return jacobianTransposeIK_chain(jointIndices, jointValues, target, linkageFinalTF);
+    return jacobianTransposeIK_chain(group.indices, jointValues, target, linkageFinalTF);
 }
 
 
 
-// TODO: Make a constraint class instead of restValues
-rk_result_t Robot::dampedLeastSquaresIK_chain(const vector<size_t> &jointIndices, VectorXd &jointValues,
-                                              const TRANSFORM &target, Constraints& constraints )
+// Rotation and translation that take pose to target, the rotation given as
+// angle times axis with the angle in [-pi, pi]. Returns the raw angle.
+static double poseError(const TRANSFORM& pose, const TRANSFORM& target, TRANSLATION& Terr, TRANSLATION& Rerr)
 {
-    bool storedImposeLimits = imposeLimits;
+    AngleAxisd aaerr(target.rotation()*pose.rotation().transpose());
 
-    vector<Joint*> pJoints;
-    pJoints.resize(jointIndices.size());
-    // FIXME: Add in safety checks
-    for(int i=0; i<pJoints.size(); i++)
-        pJoints[i] = joints_[jointIndices[i]];
+    if(fabs(aaerr.angle()) <= M_PI)
+        Rerr = aaerr.angle()*aaerr.axis();
+    else
+        Rerr = (aaerr.angle()-2*M_PI)*aaerr.axis();
+
+    Terr = target.translation()-pose.translation();
+
+    return aaerr.angle();
+}
+
+rk_result_t RobotKin::dampedLeastSquaresIK(KinematicState& state, const vector<size_t>& jointIndices,
+                                           VectorXd& jointValues, const TRANSFORM& target,
+                                           Constraints& constraints)
+{
+    bool storedImposeLimits = state.getImposeLimits();
 
     // ~~ Declarations ~~
     MatrixXd J;
-    MatrixXd Jinv;
     TRANSFORM pose;
-    AngleAxisd aagoal(target.rotation());
-    AngleAxisd aastate;
-    AngleAxisd aaerr;
     TRANSLATION Terr;
     TRANSLATION Rerr;
     SCREW err;
-    VectorXd nullErr(jointValues.size());
     VectorXd delta(jointValues.size());
     VectorXd stored(jointValues.size());
     VectorXd f(jointValues.size());
-    double rotAngle=0;
-
-    VectorXd deltaNull(jointValues.size());
-
 
     stored = jointValues;
 
@@ -1008,7 +1127,6 @@ rk_result_t Robot::dampedLeastSquaresIK_chain(const vector<size_t> &jointIndices
     int maxIterations = constraints.maxIterations;
     double damp = constraints.dampingConstant;
 
-
     size_t maxAttempts = 1;
     if(constraints.useIterativeJacobianSeed)
         maxAttempts = constraints.maxAttempts;
@@ -1016,27 +1134,12 @@ rk_result_t Robot::dampedLeastSquaresIK_chain(const vector<size_t> &jointIndices
     for(size_t attempt=0; attempt<maxAttempts; attempt++)
     {
         if(constraints.useIterativeJacobianSeed)
-            constraints.iterativeJacobianSeed(*this, attempt, jointIndices, jointValues);
-
-        values(jointIndices, jointValues);
-
-        pose = joint(jointIndices.back()).respectToRobot()*constraints.finalTransform;
-//        pose = constraints.finalTransform*joint(jointIndices.back()).respectToRobot();
-        aastate = pose.rotation();
-
-//        aaerr = pose.rotation().transpose()*target.rotation(); // FAILED
-//        aaerr = target.rotation().transpose()*pose.rotation(); // FAILED
-//        aaerr = pose.rotation()*target.rotation().transpose(); // FAILED
-        aaerr = target.rotation()*pose.rotation().transpose();
-        if(fabs(aaerr.angle()) <= M_PI)
-            Rerr = aaerr.angle()*aaerr.axis();
-        else
-            Rerr = (aaerr.angle()-2*M_PI)*aaerr.axis();
+            constraints.iterativeJacobianSeed(state, attempt, jointIndices, jointValues);
 
-        Terr = target.translation()-pose.translation();
+        state.values(jointIndices, jointValues);
 
-    //    Rerr.setZero();
-        err << Terr, Rerr;//*constraints.rotationScale;
+        pose = state.jointRespectToRobot(jointIndices.back())*constraints.finalTransform;
+        poseError(pose, target, Terr, Rerr);
 
         size_t iterations = 0;
         do {
@@ -1046,180 +1149,97 @@ rk_result_t Robot::dampedLeastSquaresIK_chain(const vector<size_t> &jointIndices
                 clampMag(Terr, constraints.translationClamp);
                 clampMag(Rerr, constraints.rotationClamp);
             }
-            err << Terr, Rerr;//*constraints.rotationScale;
+            err << Terr, Rerr;
 
             if(constraints.customErrorClamp)
-                constraints.errorClamp(*this, jointIndices, err);
+                constraints.errorClamp(state, jointIndices, err);
 
-            if(verbose)
+            if(state.verbose())
             {
                 cout << "Clamped Error: " << err.transpose() << endl;
 
                 cout << "-----------------------------------" << endl;
             }
 
-//            jacobian(J, pJoints, pJoints.back()->respectToRobot().translation()+constraints.finalTransform.translation(), this);
-            jacobian(J, pJoints, pose.translation(), this);
-
-            /////////////////////////////////////////////////////////////////////////
-            /////////////////////////  STANDARD APPROACH  ///////////////////////////
-            /////////////////////////////////////////////////////////////////////////
+            state.jacobian(J, jointIndices, pose.translation());
 
             f = (J*J.transpose() + damp*damp*Matrix6d::Identity()).colPivHouseholderQr().solve(err);
             delta = J.transpose()*f;
 
-            /////////////////////////////////////////////////////////////////////////
-            /////////////////////////////////////////////////////////////////////////
-
-
-            if(constraints.performNullSpaceTask)
-                delta += constraints.nullSpaceTask(*this, J, jointIndices, jointValues);
-
-
-
-            ///////////////////////////////////////////////////////////////////
-            ///////////////////////  NULL SPACE APPROACH //////////////////////
-            ///////////////////////////////////////////////////////////////////
-/*
-            Jinv = J.transpose()*(J*J.transpose() + damp*damp*Matrix6d::Identity()).inverse();
-
-            delta = Jinv*err;
-
-            if(constraints.performDeltaClamp)
-                clampMaxAbs(delta, constraints.deltaClamp);
-
-
             if(constraints.performNullSpaceTask)
-                constraints.nullSpaceTask(*this, jointIndices, jointValues, nullErr);
-            else
-                nullErr.setZero();
-
-            // Try pure nullspace first
-            deltaNull = (Matrix6d::Identity() - J.transpose()*(J*J.transpose()).inverse()*J)*nullErr;
-
-            // The damped nullspace is much better for avoiding NaNs
-            for(int n=0; n<deltaNull.size(); n++)
-            {
-                if(deltaNull[n] != deltaNull[n])
-                {
-                    deltaNull = (Matrix6d::Identity() - Jinv*J)*nullErr;
-                    cout << "NaN in the Nullspace!!" << endl;
-                    break;
-                }
-            }
-
-            delta += deltaNull;
-*/
-            ///////////////////////////////////////////////////////////////////
-
+                delta += constraints.nullSpaceTask(state, J, jointIndices, jointValues);
 
             jointValues += delta;
 
             if(constraints.wrapToJointLimits)
-                wrapToJointLimits(*this, jointIndices, jointValues);
+                wrapToJointLimits(state, jointIndices, jointValues);
 
-
-            values(jointIndices, jointValues);
+            state.values(jointIndices, jointValues);
 
             // Catch any joint limits
-            for(int k=0; k<jointIndices.size(); k++)
-                jointValues(k) = joint(jointIndices[k]).value();
+            for(size_t k=0; k<jointIndices.size(); k++)
+                jointValues(k) = state.value(jointIndices[k]);
 
-            pose = joint(jointIndices.back()).respectToRobot()*constraints.finalTransform;
-//            pose = constraints.finalTransform*joint(jointIndices.back()).respectToRobot();
+            pose = state.jointRespectToRobot(jointIndices.back())*constraints.finalTransform;
 
-            if(verbose)
+            if(state.verbose())
             {
                 cout << "req delta: " << delta.transpose() << endl;
                 cout << "act delta: " << (jointValues-stored).transpose() << endl;
                 cout << "angles: " << jointValues.transpose() << endl;
                 cout << "Limits: ";
-                for(int k=0; k<jointIndices.size(); k++)
-                    cout << "(" << joint(jointIndices[k]).min() << ", "
-                         << joint(jointIndices[k]).max() << ")\t";
+                for(size_t k=0; k<jointIndices.size(); k++)
+                    cout << "(" << state.min(jointIndices[k]) << ", "
+                         << state.max(jointIndices[k]) << ")\t";
                 cout << endl;
                 cout << pose.matrix() << endl;
                 cout << "Rotation needed: " << endl;
                 cout << (pose.rotation().transpose()*target.rotation()).matrix() << endl;
             }
-            
-            
-            Terr = target.translation()-pose.translation();
-
-//            aaerr = pose.rotation().transpose()*target.rotation(); // FAILED
-//            aaerr = target.rotation().transpose()*pose.rotation(); // FAILED
-//            aaerr = pose.rotation()*target.rotation().transpose();
-            aaerr = target.rotation()*pose.rotation().transpose();
-
-//            cout << "Angle-Axis: (" << aaerr.angle()/M_PI*180 << ")\t" << aaerr.axis().transpose() << endl;
 
-            if(aaerr.angle() > 2*M_PI || aaerr.angle() < 0)
-                cout << "BROKEN ANGLE AXIS: " << aaerr.angle() << endl
+            double angle = poseError(pose, target, Terr, Rerr);
+            if(angle > 2*M_PI || angle < 0)
+                cout << "BROKEN ANGLE AXIS: " << angle << endl
                      << " -- Please contact mxgrey@gatech.edu and report this." << endl;
-                
-            if(fabs(aaerr.angle()) <= M_PI)
-                Rerr = aaerr.angle()*aaerr.axis();
-            else
-                Rerr = (aaerr.angle()-2*M_PI)*aaerr.axis();
-
-//            rotAngle = wrapToPi(aaerr.angle()); // This failed badly
-//            Rerr = rotAngle*aaerr.axis();
 
             err << Terr, Rerr;
 
-            if(verbose)
+            if(state.verbose())
             {
                 cout << "Error: " << err.transpose() << endl;
             }
 
             iterations++;
 
-
-//        } while(err.norm() > tolerance && iterations < maxIterations);
         } while( (Terr.norm() > tolerance || Rerr.norm() > tolerance || !constraints.nullComplete())
                  && iterations < maxIterations);
 
-        if(verbose)
+        if(state.verbose())
         {
             cout << "Iterations: -- " << iterations << endl;
         }
 
-
         if(constraints.wrapSolutionToJointLimits)
-            wrapToJointLimits(*this, jointIndices, jointValues);
-
-        imposeLimits = storedImposeLimits;
-        values(jointIndices, jointValues);
-
-
-        pose = joint(jointIndices.back()).respectToRobot()*constraints.finalTransform;
-//        pose = constraints.finalTransform*joint(jointIndices.back()).respectToRobot();
-        
-        
-//        aaerr = pose.rotation().transpose()*target.rotation(); // FAILED
-//        aaerr = target.rotation().transpose()*pose.rotation(); // FAILED
-//        aaerr = pose.rotation()*target.rotation().transpose(); // FAILED
-        aaerr = target.rotation()*pose.rotation().transpose();
-        if(fabs(aaerr.angle()) <= M_PI)
-            Rerr = aaerr.angle()*aaerr.axis();
-        else
-            Rerr = (aaerr.angle()-2*M_PI)*aaerr.axis();
-        
-        Terr = target.translation()-pose.translation();
-//            Rerr = -aaerr.angle()*aaerr.axis();
+            wrapToJointLimits(state, jointIndices, jointValues);
 
-        err << Terr, Rerr;
+        state.setImposeLimits(storedImposeLimits);
+        state.values(jointIndices, jointValues);
 
+        pose = state.jointRespectToRobot(jointIndices.back())*constraints.finalTransform;
+        poseError(pose, target, Terr, Rerr);
 
         if(Terr.norm() <= tolerance && Rerr.norm() <= tolerance)
             return RK_SOLVED;
     }
 
-
-
-
     return RK_DIVERGED;
+}
 
+rk_result_t Robot::dampedLeastSquaresIK_chain(const vector<size_t> &jointIndices, VectorXd &jointValues,
+                                              const TRANSFORM &target, Constraints& constraints )
+{
+    RobotKinematicState state(*this);
+    return RobotKin::dampedLeastSquaresIK(state, jointIndices, jointValues, target, constraints);
 }
 
 rk_result_t Robot::dampedLeastSquaresIK_chain(const vector<string> &jointNames, VectorXd &jointValues,
@@ -1237,20 +1257,109 @@ rk_result_t Robot::dampedLeastSquaresIK_chain(const vector<string> &jointNames,
 rk_result_t Robot::dampedLeastSquaresIK_linkage(const string linkageName, VectorXd &jointValues,
                                                 const TRANSFORM &target, Constraints& constraints)
 {
-    if(linkage(linkageName).name().compare("invalid")==0)
+    LinkageHandle handle = linkageHandle(linkageName);
+    if(!isValid(handle))
         return RK_INVALID_LINKAGE;
 
-    vector<size_t> jointIndices;
-    jointIndices.resize(linkage(linkageName).joints_.size());
-    for(size_t i=0; i<linkage(linkageName).joints_.size(); i++)
-        jointIndices[i] = linkage(linkageName).joints_[i]->id();
+    return dampedLeastSquaresIK(jointGroupHandle(handle), jointValues, target, constraints);
+}
 
-    constraints.finalTransform = linkage(linkageName).tool().respectToFixed();
+rk_result_t Robot::dampedLeastSquaresIK(const JointGroupHandle& group, VectorXd &jointValues,
+                                        const TRANSFORM &target, Constraints& constraints)
+{
+    if(!isValid(group))
+        return group.linkage < 0 ? RK_INVALID_JOINT : RK_INVALID_LINKAGE;
 
+    if(group.linkage >= 0)
+        constraints.finalTransform = linkages_[group.linkage]->tool().respectToFixed();
+
+    return dampedLeastSquaresIK_chain(group.indices, jointValues, target, constraints);
+}
+
+rk_result_t Robot::dampedLeastSquaresIK_chain(const vector<size_t> &jointIndices, VectorXd &jointValues,
+                                              const TRANSFORM &target)
+{
+    Constraints constraints;
     return dampedLeastSquaresIK_chain(jointIndices, jointValues, target, constraints);
 }
 
+rk_result_t Robot::dampedLeastSquaresIK_chain(const vector<string> &jointNames, VectorXd &jointValues,
+                                              const TRANSFORM &target)
+{
+    Constraints constraints;
+    return dampedLeastSquaresIK_chain(jointNames, jointValues, target, constraints);
+}
+
+rk_result_t Robot::dampedLeastSquaresIK_linkage(const string linkageName, VectorXd &jointValues,
+                                                const TRANSFORM &target)
+{
+    Constraints constraints;
+    return dampedLeastSquaresIK_linkage(linkageName, jointValues, target, constraints);
+}
+
+rk_result_t Robot::dampedLeastSquaresIK(const JointGroupHandle& group, VectorXd &jointValues,
+                                        const TRANSFORM &target)
+{
+    Constraints constraints;
+    return dampedLeastSquaresIK(group, jointValues, target, constraints);
+}
+
+
 
 
 
 
+
+rk_result_t RobotModel::dampedLeastSquaresIK_chain(RobotState& state, const vector<size_t> &jointIndices,
+                                                   VectorXd &jointValues, const TRANSFORM &target,
+                                                   Constraints& constraints) const
+{
+    ModelKinematicState modelState(state);
+    return RobotKin::dampedLeastSquaresIK(modelState, jointIndices, jointValues, target, constraints);
+}
+
+rk_result_t RobotModel::dampedLeastSquaresIK_chain(RobotState& state, const vector<string> &jointNames,
+                                                   VectorXd &jointValues, const TRANSFORM &target,
+                                                   Constraints& constraints) const
+{
+    vector<size_t> jointIndices;
+
+    if( jointNamesToIndices(jointNames, jointIndices) == RK_INVALID_JOINT )
+        return RK_INVALID_JOINT;
+
+    return dampedLeastSquaresIK_chain(state, jointIndices, jointValues, target, constraints);
+}
+
+rk_result_t RobotModel::dampedLeastSquaresIK_linkage(RobotState& state, const string linkageName,
+                                                     VectorXd &jointValues, const TRANSFORM &target,
+                                                     Constraints& constraints) const
+{
+    size_t index = linkageIndex(linkageName);
+    if(index == nLinkages())
+        return RK_INVALID_LINKAGE;
+
+    constraints.finalTransform = kinematics_.fixed(kinematics_.toolFrame(index));
+
+    return dampedLeastSquaresIK_chain(state, linkageJoints_[index], jointValues, target, constraints);
+}
+
+rk_result_t RobotModel::dampedLeastSquaresIK_chain(RobotState& state, const vector<size_t> &jointIndices,
+                                                   VectorXd &jointValues, const TRANSFORM &target) const
+{
+    Constraints constraints;
+    return dampedLeastSquaresIK_chain(state, jointIndices, jointValues, target, constraints);
+}
+
+rk_result_t RobotModel::dampedLeastSquaresIK_chain(RobotState& state, const vector<string> &jointNames,
+                                                   VectorXd &jointValues, const TRANSFORM &target) const
+{
+    Constraints constraints;
+    return dampedLeastSquaresIK_chain(state, jointNames, jointValues, target, constraints);
+}
+
+rk_result_t RobotModel::dampedLeastSquaresIK_linkage(RobotState& state, const string linkageName,
+                                                     VectorXd &jointValues, const TRANSFORM &target) const
+{
+    Constraints constraints;
+    return dampedLeastSquaresIK_linkage(state, linkageName, jointValues, target, constraints);
+}
@@ -0,0 +1,1780 @@
+
+
+
+//------------------------------------------------------------------------------
+// Includes
+//------------------------------------------------------------------------------
+#include <iostream>
+#include <vector>
+#include <cstdlib>
+#include <sstream>
+#include "Frame.h"
+#include "Linkage.h"
+#include "Robot.h"
+#include "Hubo.h"
+#include "CompiledKinematics.h"
+#include "RobotModel.h"
+#include "FixedChain.h"
+#include "RigidTransform.h"
+#include "ScrewChain.h"
+#include "RelativeTransforms.h"
+#include "NameTable.h"
+
+
+
+//------------------------------------------------------------------------------
+// Namespaces
+//------------------------------------------------------------------------------
+using namespace std;
+using namespace Eigen;
+using namespace RobotKin;
+
+
+//------------------------------------------------------------------------------
+// Function Declarations
+//------------------------------------------------------------------------------
+bool lazyUpdateTest();
+bool batchUpdateTest();
+bool compiledKinematicsTest();
+bool constForwardKinematicsTest();
+bool robotStateTest();
+bool batchForwardKinematicsTest();
+bool fixedChainTest();
+bool jointKernelTest();
+bool rigidTransformTest();
+bool screwChainTest();
+bool suffixUpdateTest();
+bool worldCacheTest();
+bool relativeTransformTest();
+bool deepTreeTest();
+bool collapseAnchorsTest();
+bool arenaTest();
+bool handleTest();
+bool invalidLookupTest();
+bool cloneTest();
+bool snapshotTest();
+bool jacobianWorkspaceTest();
+bool frameJacobianTest();
+bool jacobianDotTest();
+bool hessianTest();
+bool centerOfMassJacobianTest();
+
+TRANSFORM referenceToolPose(Robot& robot, size_t linkageIndex);
+TRANSFORM referenceJointPose(Robot& robot, size_t jointIndex);
+TRANSFORM referenceLinkagePose(Robot& robot, size_t linkageIndex);
+bool isApprox(const TRANSFORM& a, const TRANSFORM& b, double tol=1e-10);
+void randomValues(Robot& robot, VectorXd& q);
+Matrix3d robotInertia(Robot& robot, TRANSLATION& com);
+bool check(bool condition, string description);
+
+int failures = 0;
+
+
+//------------------------------------------------------------------------------
+// Main Function
+//------------------------------------------------------------------------------
+int main()
+{
+    srand(12345);
+
+    lazyUpdateTest();
+    batchUpdateTest();
+    compiledKinematicsTest();
+    constForwardKinematicsTest();
+    robotStateTest();
+    batchForwardKinematicsTest();
+    fixedChainTest();
+    jointKernelTest();
+    rigidTransformTest();
+    screwChainTest();
+    suffixUpdateTest();
+    worldCacheTest();
+    relativeTransformTest();
+    deepTreeTest();
+    collapseAnchorsTest();
+    arenaTest();
+    handleTest();
+    invalidLookupTest();
+    cloneTest();
+    snapshotTest();
+    jacobianWorkspaceTest();
+    frameJacobianTest();
+    jacobianDotTest();
+    hessianTest();
+    centerOfMassJacobianTest();
+
+    if(failures > 0)
+    {
+        cout << failures << " check(s) FAILED" << endl;
+        return 1;
+    }
+
+    cout << "All checks passed" << endl;
+    return 0;
+}
+
+
+//------------------------------------------------------------------------------
+// Tests
+//------------------------------------------------------------------------------
+bool lazyUpdateTest()
+{
+    cout << "------------------------------" << endl;
+    cout << "| Testing Lazy Frame Updates |" << endl;
+    cout << "------------------------------" << endl;
+
+    Hubo hubo;
+    hubo.imposeLimits = false;
+
+    VectorXd q;
+    randomValues(hubo, q);
+    hubo.values(q);
+
+    bool ok = true;
+    for(size_t i=0; i<hubo.nJoints(); i++)
+        ok &= isApprox(hubo.joint(i).respectToRobot(), referenceJointPose(hubo, i));
+    check(ok, "Joint frames after Robot::values()");
+
+    ok = true;
+    for(size_t i=0; i<hubo.nLinkages(); i++)
+        ok &= isApprox(hubo.linkage(i).tool().respectToRobot(), referenceToolPose(hubo, i));
+    check(ok, "Tool frames after Robot::values()");
+
+    // Moving the torso must move the hands, which live in child linkages
+    hubo.joint("TOR").value(0.7);
+    size_t leftArm = hubo.linkageIndex("LEFT_ARM");
+    check(isApprox(hubo.linkage(leftArm).tool().respectToRobot(), referenceToolPose(hubo, leftArm)),
+          "Child linkage follows a parent joint write");
+
+    // Deferred writes must never require an explicit Robot::updateFrames()
+    for(size_t i=0; i<hubo.nJoints(); i++)
+        hubo.setJointValue(i, 0.1*i, false);
+    ok = true;
+    for(size_t i=0; i<hubo.nLinkages(); i++)
+        ok &= isApprox(hubo.linkage(i).tool().respectToWorld(), referenceToolPose(hubo, i));
+    check(ok, "Tool frames after deferred joint writes");
+
+    // Changing a fixed transform must invalidate the descendants as well
+    TRANSFORM offset(TRANSFORM::Identity());
+    offset.translate(TRANSLATION(0.1, -0.2, 0.3));
+    hubo.linkage("TORSO").respectToFixed(offset);
+    check(isApprox(hubo.linkage(leftArm).tool().respectToRobot(), referenceToolPose(hubo, leftArm)),
+          "Child linkage follows a parent fixed transform change");
+
+    hubo.linkage("TORSO").tool().respectToFixed(offset);
+    check(isApprox(hubo.joint("LSP").respectToRobot(), referenceJointPose(hubo, hubo.jointIndex("LSP"))),
+          "Child linkage follows a parent tool change");
+
+    // The Jacobian must see the latest joint values
+    MatrixXd J;
+    Linkage& arm = hubo.linkage(leftArm);
+    arm.joint(2).value(0.3);
+    arm.jacobian(J, arm.const_tool().respectToLinkage().translation(), &arm);
+    TRANSLATION before = arm.tool().respectToLinkage().translation();
+    double eps = 1e-6;
+    arm.joint(2).value(0.3 + eps);
+    TRANSLATION after = arm.tool().respectToLinkage().translation();
+    check(((after-before)/eps - J.block(0,2,3,1)).norm() < 1e-4,
+          "Jacobian uses the latest joint values");
+
+    return failures == 0;
+}
+
+
+bool batchUpdateTest()
+{
+    cout << "--------------------------------" << endl;
+    cout << "| Testing Batched Joint Writes |" << endl;
+    cout << "--------------------------------" << endl;
+
+    Hubo hubo;
+
+    {
+        JointWriteBatch batch(hubo);
+        check(hubo.updating(), "Robot reports an open batch");
+
+        hubo.setJointValue("TOR", 0.4);
+        hubo.beginUpdate();
+        hubo.joint("LSR").value(0.5);
+        check(hubo.joint("LEP").value(10.0) == RK_HIT_UPPER_LIMIT,
+              "Writes inside a batch are limit-checked");
+        hubo.commit();
+        check(hubo.updating(), "Nested commit keeps the outer batch open");
+    }
+    check(!hubo.updating(), "Batch closes at the end of its scope");
+
+    bool ok = true;
+    for(size_t i=0; i<hubo.nLinkages(); i++)
+        ok &= isApprox(hubo.linkage(i).tool().respectToRobot(), referenceToolPose(hubo, i));
+    check(ok, "Tool frames after a committed batch");
+
+    return failures == 0;
+}
+
+
+bool compiledKinematicsTest()
+{
+    cout << "-------------------------------" << endl;
+    cout << "| Testing Compiled Kinematics |" << endl;
+    cout << "-------------------------------" << endl;
+
+    Hubo hubo;
+    hubo.imposeLimits = false;
+    CompiledKinematics compiled(hubo);
+
+    check(compiled.nJoints() == hubo.nJoints(), "Compiled model has every joint");
+    check(compiled.nFrames() == hubo.nJoints() + 2*hubo.nLinkages(),
+          "Compiled model has a base and a tool frame per linkage");
+
+    bool ordered = true;
+    for(size_t i=0; i<compiled.nFrames(); i++)
+        ordered &= compiled.parent(i) < (int)i;
+    check(ordered, "Frames are in topological order");
+
+    VectorXd q;
+    randomValues(hubo, q);
+    hubo.values(q);
+
+    vector<TRANSFORM> frames;
+    compiled.forwardKinematics(q, frames);
+
+    bool ok = true;
+    for(size_t i=0; i<hubo.nJoints(); i++)
+        ok &= isApprox(frames[compiled.jointFrame(i)], hubo.joint(i).respectToRobot());
+    for(size_t i=0; i<hubo.nLinkages(); i++)
+    {
+        ok &= isApprox(frames[compiled.toolFrame(i)], hubo.linkage(i).tool().respectToRobot());
+        ok &= isApprox(frames[compiled.linkageFrame(i)], hubo.linkage(i).respectToRobot());
+    }
+    check(ok, "Compiled forward kinematics matches the robot");
+
+    return failures == 0;
+}
+
+
+bool constForwardKinematicsTest()
+{
+    cout << "------------------------------------" << endl;
+    cout << "| Testing Const Forward Kinematics |" << endl;
+    cout << "------------------------------------" << endl;
+
+    Hubo hubo;
+    hubo.imposeLimits = false;
+
+    VectorXd q0, q;
+    randomValues(hubo, q0);
+    randomValues(hubo, q);
+    hubo.values(q0);
+    TRANSFORM hand = hubo.linkage("LEFT_ARM").tool().respectToRobot();
+
+    const Robot& constHubo = hubo;
+    vector<TRANSFORM> jointPoses, toolPoses;
+    constHubo.forwardKinematics(q, jointPoses, toolPoses);
+
+    check((hubo.values() - q0).norm() == 0
+          && isApprox(hubo.linkage("LEFT_ARM").tool().respectToRobot(), hand),
+          "Robot state is untouched");
+
+    hubo.values(q);
+    bool ok = true;
+    for(size_t i=0; i<hubo.nJoints(); i++)
+        ok &= isApprox(jointPoses[i], hubo.joint(i).respectToRobot());
+    for(size_t i=0; i<hubo.nLinkages(); i++)
+        ok &= isApprox(toolPoses[i], hubo.linkage(i).tool().respectToRobot());
+    check(ok, "Robot forward kinematics matches the joint frames");
+
+    vector<TRANSFORM> previousTools = toolPoses;
+    toolPoses[0] = TRANSFORM(Translation3d(1.0, 2.0, 3.0));
+    constHubo.forwardKinematics(VectorXd::Zero(hubo.nJoints()+1), jointPoses, toolPoses);
+    check(isApprox(toolPoses[0], TRANSFORM(Translation3d(1.0, 2.0, 3.0)))
+          && isApprox(toolPoses[1], previousTools[1]),
+          "Wrong number of values leaves reused buffers alone");
+
+    const Linkage& arm = hubo.const_linkage("RIGHT_ARM");
+    vector<TRANSFORM> linkagePoses;
+    arm.forwardKinematics(VectorXd::Constant(arm.nJoints(), 0.2), linkagePoses);
+    hubo.linkage("RIGHT_ARM").values(VectorXd::Constant(arm.nJoints(), 0.2));
+    check(isApprox(linkagePoses.back(), arm.const_tool().respectToLinkage())
+          && isApprox(linkagePoses[2], arm.const_joint(2).respectToLinkage()),
+          "Linkage forward kinematics matches the linkage frames");
+
+    return failures == 0;
+}
+
+
+bool robotStateTest()
+{
+    cout << "---------------------------------" << endl;
+    cout << "| Testing Robot Model and State |" << endl;
+    cout << "---------------------------------" << endl;
+
+    Hubo hubo;
+    RobotModel model(hubo);
+
+    check(model.nJoints() == hubo.nJoints() && model.nLinkages() == hubo.nLinkages(),
+          "Model has every joint and linkage");
+    check(model.jointIndex("LEP") == hubo.jointIndex("LEP")
+          && model.jointIndex("NOT_A_JOINT") == model.nJoints(),
+          "Model joint name lookups");
+
+    RobotState state(model);
+    state.imposeLimits = false;
+    hubo.imposeLimits = false;
+
+    VectorXd q;
+    randomValues(hubo, q);
+    state.values(q);
+    hubo.values(q);
+
+    bool ok = true;
+    for(size_t i=0; i<hubo.nJoints(); i++)
+        ok &= isApprox(state.jointRespectToRobot(i), hubo.joint(i).respectToRobot());
+    for(size_t i=0; i<hubo.nLinkages(); i++)
+        ok &= isApprox(state.toolRespectToRobot(i), hubo.linkage(i).tool().respectToRobot());
+    check(ok, "State frames match the robot");
+
+    RobotState other(model);
+    other.value(0, 0.3);
+    check(state.values() == q && other.values()[0] == 0.3,
+          "States are independent of each other");
+
+    check(other.value(hubo.jointIndex("LEP"), 10.0) == RK_HIT_UPPER_LIMIT
+          && other.value(hubo.jointIndex("LEP")) == model.max(hubo.jointIndex("LEP")),
+          "State imposes the model joint limits");
+
+    // Solve for a pose the arm is known to reach
+    hubo.imposeLimits = true;
+    const vector<size_t>& arm = model.linkageJoints(model.linkageIndex("RIGHT_ARM"));
+    VectorXd armValues(arm.size());
+    for(size_t i=0; i<arm.size(); i++)
+        armValues[i] = 0.5*(model.min(arm[i]) + model.max(arm[i])) + 0.1;
+    RobotState goal(model);
+    goal.values(arm, armValues);
+    TRANSFORM target = goal.toolRespectToRobot(model.linkageIndex("RIGHT_ARM"));
+
+    RobotState solver(model);
+    Constraints constraints;
+    VectorXd solution = VectorXd::Zero(arm.size());
+    rk_result_t result = model.dampedLeastSquaresIK_linkage(solver, "RIGHT_ARM", solution, target, constraints);
+    check(result == RK_SOLVED
+          && (solver.toolRespectToRobot(model.linkageIndex("RIGHT_ARM")).translation()
+              - target.translation()).norm() < 1e-3,
+          "Damped least squares solves on a state");
+
+    VectorXd robotSolution = VectorXd::Zero(arm.size());
+    Constraints robotConstraints;
+    hubo.values(VectorXd::Zero(hubo.nJoints()));
+    hubo.dampedLeastSquaresIK_linkage("RIGHT_ARM", robotSolution, target, robotConstraints);
+    check((robotSolution - solution).norm() < 1e-8,
+          "State solver matches the robot solver");
+
+    // A hook override has to reach both solvers
+    class CountingConstraints : public Constraints
+    {
+    public:
+        CountingConstraints() : calls(0) { customErrorClamp = true; }
+        using Constraints::errorClamp;
+        void errorClamp(KinematicState&, const vector<size_t>&, SCREW&) { calls++; }
+        size_t calls;
+    };
+
+    // Subclasses written against the Robot& hooks
+    class RobotCountingConstraints : public Constraints
+    {
+    public:
+        RobotCountingConstraints() : calls(0) { customErrorClamp = true; }
+        using Constraints::errorClamp;
+        void errorClamp(Robot&, const vector<size_t>&, SCREW&) { calls++; }
+        size_t calls;
+    };
+
+    CountingConstraints stateHooks;
+    solution.setZero();
+    solver.values(VectorXd::Zero(model.nJoints()));
+    model.dampedLeastSquaresIK_linkage(solver, "RIGHT_ARM", solution, target, stateHooks);
+
+    CountingConstraints robotHooks;
+    robotSolution.setZero();
+    hubo.values(VectorXd::Zero(hubo.nJoints()));
+    hubo.dampedLeastSquaresIK_linkage("RIGHT_ARM", robotSolution, target, robotHooks);
+    check(stateHooks.calls > 0 && stateHooks.calls == robotHooks.calls,
+          "Constraints hooks run on both solvers");
+
+    RobotCountingConstraints legacyHooks;
+    robotSolution.setZero();
+    hubo.values(VectorXd::Zero(hubo.nJoints()));
+    hubo.dampedLeastSquaresIK_linkage("RIGHT_ARM", robotSolution, target, legacyHooks);
+    check(legacyHooks.calls == robotHooks.calls, "Robot& hooks still run on the robot solver");
+
+    return failures == 0;
+}
+
+
+bool batchForwardKinematicsTest()
+{
+    cout << "------------------------------------" << endl;
+    cout << "| Testing Batch Forward Kinematics |" << endl;
+    cout << "------------------------------------" << endl;
+
+    Hubo hubo;
+    CompiledKinematics compiled(hubo);
+
+    // Not a multiple of the internal chunk size on purpose
+    int nConfigs = 75;
+    JointBatch Q(hubo.nJoints(), nConfigs);
+    VectorXd q;
+    for(int k=0; k<nConfigs; k++)
+    {
+        randomValues(hubo, q);
+        Q.col(k) = q;
+    }
+
+    vector<TRANSFORM> batchFrames, frames;
+    compiled.batchForwardKinematics(Q, batchFrames);
+
+    bool ok = batchFrames.size() == nConfigs*compiled.nFrames();
+    for(int k=0; k<nConfigs && ok; k++)
+    {
+        compiled.forwardKinematics(VectorXd(Q.col(k)), frames);
+        for(size_t f=0; f<compiled.nFrames(); f++)
+            ok &= isApprox(batchFrames[k*compiled.nFrames()+f], frames[f]);
+    }
+    check(ok, "Batched frames match single configurations");
+
+    size_t leftLeg = hubo.linkageIndex("LEFT_LEG");
+    vector<TRANSFORM> poses;
+    compiled.batchToolPoses(Q, leftLeg, poses);
+    ok = poses.size() == (size_t)nConfigs;
+    for(int k=0; k<nConfigs && ok; k++)
+        ok &= isApprox(poses[k], batchFrames[k*compiled.nFrames()+compiled.toolFrame(leftLeg)]);
+    check(ok, "Batched tool poses match the batched frames");
+
+    const Linkage& arm = hubo.const_linkage("LEFT_ARM");
+    JointBatch armQ = Q.topRows(arm.nJoints());
+    arm.batchForwardKinematics(armQ, poses);
+    ok = poses.size() == (size_t)nConfigs;
+    for(int k=0; k<nConfigs && ok; k++)
+    {
+        arm.forwardKinematics(VectorXd(armQ.col(k)), frames);
+        ok &= isApprox(poses[k], frames.back());
+    }
+    check(ok, "Batched linkage tool poses match single configurations");
+
+    return failures == 0;
+}
+
+
+bool fixedChainTest()
+{
+    cout << "----------------------------" << endl;
+    cout << "| Testing Fixed Size Chain |" << endl;
+    cout << "----------------------------" << endl;
+
+    Hubo hubo;
+    Linkage& arm = hubo.linkage("LEFT_ARM");
+    FixedChain<6> chain(arm);
+    FixedChain<Eigen::Dynamic> dynamicChain(arm);
+
+    check(chain.nJoints() == 6 && dynamicChain.nJoints() == 6, "Chains have every joint");
+
+    FixedChain<7> wrongSize(arm);
+    FixedChain<7>::Values q7 = FixedChain<7>::Values::Zero();
+    TRANSFORM wrongTool;
+    FixedChain<7>::Jacobian wrongJ;
+    wrongSize.jacobian(q7, wrongJ, wrongTool);
+    check(!wrongSize.valid() && !wrongSize.extract(arm) && chain.valid()
+          && wrongJ.isZero() && isApprox(wrongTool, TRANSFORM::Identity())
+          && wrongSize.dampedLeastSquaresIK(q7, TRANSFORM::Identity(), Constraints()) == RK_SOLVER_NOT_READY,
+          "Extraction fails on a size mismatch and leaves the chain invalid");
+
+    FixedChain<6>::Values q;
+    for(int i=0; i<q.size(); i++)
+        q[i] = 0.5*(chain.min(i) + chain.max(i)) + 0.1*i;
+    arm.values(q);
+
+    TRANSFORM tool, dynamicTool;
+    FixedChain<6>::Jacobian J;
+    FixedChain<Eigen::Dynamic>::Jacobian dynamicJ;
+    MatrixXd linkageJ;
+    chain.jacobian(q, J, tool);
+    dynamicChain.jacobian(VectorXd(q), dynamicJ, dynamicTool);
+    arm.jacobian(linkageJ, arm.const_tool().respectToLinkage().translation(), &arm);
+
+    check(isApprox(tool, arm.const_tool().respectToLinkage()) && isApprox(dynamicTool, tool),
+          "Chain forward kinematics matches the linkage");
+    check((J - linkageJ).norm() < 1e-10 && (dynamicJ - linkageJ).norm() < 1e-10,
+          "Chain Jacobian matches the linkage");
+
+    Constraints constraints;
+    FixedChain<6>::Values solution = FixedChain<6>::Values::Zero();
+    rk_result_t result = chain.dampedLeastSquaresIK(solution, tool, constraints);
+    chain.forwardKinematics(solution, dynamicTool);
+    check(result == RK_SOLVED && (dynamicTool.translation() - tool.translation()).norm() < 1e-3,
+          "Fixed size damped least squares converges");
+
+    VectorXd dynamicSolution = VectorXd::Zero(6);
+    dampedLeastSquaresIK_fixedChain(arm, dynamicSolution, tool, constraints);
+    check((dynamicSolution - VectorXd(solution)).norm() < 1e-12,
+          "Dispatcher matches the fixed size solver");
+
+    return failures == 0;
+}
+
+
+bool jointKernelTest()
+{
+    cout << "-------------------------" << endl;
+    cout << "| Testing Joint Kernels |" << endl;
+    cout << "-------------------------" << endl;
+
+    TRANSFORM fixed(TRANSFORM::Identity());
+    fixed.rotate(AngleAxisd(0.4, Vector3d(1, 2, 3).normalized()));
+    fixed.pretranslate(TRANSLATION(0.1, -0.2, 0.3));
+
+    AXIS axes[] = { AXIS::UnitX(), AXIS::UnitY(), AXIS::UnitZ(),
+                    -AXIS::UnitX(), -AXIS::UnitY(), -AXIS::UnitZ(),
+                    AXIS(1, 1, 0).normalized() };
+    JointKernel revolute[] = { KERNEL_REVOLUTE_X, KERNEL_REVOLUTE_Y, KERNEL_REVOLUTE_Z,
+                               KERNEL_REVOLUTE_X, KERNEL_REVOLUTE_Y, KERNEL_REVOLUTE_Z,
+                               KERNEL_REVOLUTE };
+    JointKernel prismatic[] = { KERNEL_PRISMATIC_X, KERNEL_PRISMATIC_Y, KERNEL_PRISMATIC_Z,
+                                KERNEL_PRISMATIC_X, KERNEL_PRISMATIC_Y, KERNEL_PRISMATIC_Z,
+                                KERNEL_PRISMATIC };
+
+    bool selected = true, matches = true;
+    for(int i=0; i<7; i++)
+    {
+        Joint rJoint(fixed, "R", 0, REVOLUTE, axes[i]);
+        Joint pJoint(fixed, "P", 0, PRISMATIC, axes[i]);
+        selected &= rJoint.getJointKernel() == revolute[i] && pJoint.getJointKernel() == prismatic[i];
+
+        matches &= isApprox(rJoint.respectToFixedTransformed(0.7), fixed*AngleAxisd(0.7, axes[i]));
+        matches &= isApprox(pJoint.respectToFixedTransformed(0.7), fixed*Translation3d(0.7*axes[i]));
+    }
+    check(selected, "Kernels are chosen from the joint type and axis");
+    check(matches, "Kernels match the general joint transform");
+
+    Joint anchor(fixed, "A", 0, ANCHOR);
+    check(anchor.getJointKernel() == KERNEL_FIXED && isApprox(anchor.respectToFixedTransformed(0.7), fixed),
+          "Anchors do not move");
+
+    Hubo hubo;
+    size_t specialized = 0;
+    for(size_t i=0; i<hubo.nJoints(); i++)
+        if(hubo.joint(i).getJointKernel() != KERNEL_REVOLUTE)
+            specialized++;
+    check(specialized == hubo.nJoints(), "Every Hubo joint uses a unit axis kernel");
+
+    Joint& joint = hubo.joint("LEP");
+    joint.setJointAxis(AXIS(0, 1, 1));
+    check(joint.getJointKernel() == KERNEL_REVOLUTE
+          && isApprox(joint.respectToRobot(), referenceJointPose(hubo, joint.id())),
+          "Changing the axis changes the kernel and the frames");
+
+    return failures == 0;
+}
+
+
+bool rigidTransformTest()
+{
+    cout << "----------------------------" << endl;
+    cout << "| Testing Rigid Transforms |" << endl;
+    cout << "----------------------------" << endl;
+
+    TRANSFORM a(TRANSFORM::Identity()), b(TRANSFORM::Identity());
+    a.rotate(AngleAxisd(0.4, Vector3d(1, 2, 3).normalized()));
+    a.pretranslate(TRANSLATION(0.1, -0.2, 0.3));
+    b.rotate(AngleAxisd(-1.1, Vector3d(0, 1, -1).normalized()));
+    b.pretranslate(TRANSLATION(-0.5, 0.7, 0.2));
+
+    RigidTransform ra(a), rb(b);
+    TRANSLATION point(0.3, 0.2, 0.1);
+
+    check(isApprox(ra.toIsometry(), a) && sizeof(RigidTransform) == 12*sizeof(double),
+          "Conversion round trip with 12 doubles");
+    check(isApprox((ra*rb).toIsometry(), a*b) && isApprox(a*rb, a*b),
+          "Composition matches Isometry3d");
+    check(isApprox(ra.inverse().toIsometry(), a.inverse())
+          && isApprox(ra.inverseTimes(rb).toIsometry(), a.inverse()*b),
+          "Inverse matches Isometry3d");
+    check(((ra*point) - (a*point)).norm() < 1e-12, "Point transform matches Isometry3d");
+
+    Hubo hubo;
+    Joint& hand = hubo.joint("LWP");
+    Joint& foot = hubo.joint("RAR");
+    check(isApprox(hand.respectTo(&foot), foot.respectToWorld().inverse()*hand.respectToWorld()),
+          "Frame::respectTo() matches the general inverse");
+
+    return failures == 0;
+}
+
+
+bool screwChainTest()
+{
+    cout << "--------------------------------------" << endl;
+    cout << "| Testing Product of Exponentials FK |" << endl;
+    cout << "--------------------------------------" << endl;
+
+    Hubo hubo;
+    VectorXd q;
+    randomValues(hubo, q);
+    hubo.values(q);
+
+    // Chain through the torso into the arm, with a point beyond the wrist
+    Linkage& arm = hubo.linkage("LEFT_ARM");
+    vector<size_t> indices;
+    vector<Joint*> joints;
+    joints.push_back(&hubo.joint("TOR"));
+    for(size_t i=0; i<arm.nJoints(); i++)
+        joints.push_back(&arm.joint(i));
+    for(size_t i=0; i<joints.size(); i++)
+        indices.push_back(joints[i]->id());
+
+    TRANSFORM finalTransform(TRANSFORM::Identity());
+    finalTransform.translate(TRANSLATION(0.05, 0.02, -0.1));
+
+    ScrewChain chain(hubo, indices, finalTransform);
+    check(chain.nJoints() == indices.size(), "Chain has every joint");
+
+    VectorXd chainValues(indices.size());
+    for(size_t i=0; i<indices.size(); i++)
+        chainValues[i] = q[indices[i]];
+
+    TRANSFORM expected = hubo.joint(indices.back()).respectToRobot()*finalTransform;
+    TRANSFORM pose, jacobianPose;
+    Matrix6Xd J, Js, Jb;
+    MatrixXd robotJ;
+    chain.forwardKinematics(chainValues, pose);
+    chain.jacobian(chainValues, J, jacobianPose);
+    hubo.jacobian(robotJ, joints, expected.translation(), &hubo);
+
+    check(isApprox(pose, expected) && isApprox(jacobianPose, expected),
+          "Product of exponentials matches the robot");
+    check((J - robotJ).norm() < 1e-10, "Jacobian matches Robot::jacobian()");
+
+    chain.spaceJacobian(chainValues, Js, pose);
+    chain.bodyJacobian(chainValues, Jb, pose);
+    bool adjoints = true;
+    RigidTransform T(pose);
+    for(size_t i=0; i<chain.nJoints(); i++)
+        adjoints &= (ScrewChain::adjoint(T, Jb.col(i)) - Js.col(i)).norm() < 1e-10;
+    check(adjoints, "Body Jacobian is the space Jacobian seen from the end effector");
+
+    // Space Jacobian columns are the instantaneous screws: moving one joint
+    // along a column reproduces the change in pose
+    double h = 1e-6;
+    VectorXd dq(chainValues);
+    dq[2] += h;
+    TRANSFORM moved;
+    chain.forwardKinematics(dq, moved);
+    RigidTransform delta = RigidTransform(moved)*RigidTransform(pose).inverse();
+    RigidTransform expectedDelta = ScrewChain::exponential(Js.col(2), h);
+    check(isApprox(delta.toIsometry(), expectedDelta.toIsometry(), 1e-9),
+          "Space Jacobian columns are the current joint screws");
+
+    ScrewChain linkageChain(arm);
+    VectorXd armValues = arm.values();
+    linkageChain.jacobian(armValues, J, pose);
+    arm.jacobian(robotJ, arm.const_tool().respectToLinkage().translation(), &arm);
+    check(isApprox(pose, arm.const_tool().respectToLinkage()) && (J - robotJ).norm() < 1e-10,
+          "Linkage chain matches the linkage");
+
+    return failures == 0;
+}
+
+
+bool suffixUpdateTest()
+{
+    cout << "--------------------------------" << endl;
+    cout << "| Testing Suffix Frame Updates |" << endl;
+    cout << "--------------------------------" << endl;
+
+    Hubo hubo;
+    hubo.imposeLimits = false;
+
+    VectorXd q;
+    randomValues(hubo, q);
+    hubo.values(q);
+
+    Linkage& arm = hubo.linkage("LEFT_ARM");
+    Linkage& torso = hubo.linkage("TORSO");
+    size_t leftArm = arm.id();
+
+    // Bring everything up to date, then move only the wrist
+    arm.tool().respectToRobot();
+    arm.joint(4).value(0.4);
+    arm.joint(5).value(-0.3);
+    bool ok = true;
+    for(size_t i=0; i<arm.nJoints(); i++)
+        ok &= isApprox(arm.joint(i).respectToRobot(), referenceJointPose(hubo, arm.joint(i).id()));
+    ok &= isApprox(arm.tool().respectToRobot(), referenceToolPose(hubo, leftArm));
+    check(ok, "Wrist write updates the end of the chain");
+
+    // A later write earlier in the chain extends the dirty range
+    arm.joint(5).value(0.2);
+    arm.joint(1).value(0.6);
+    ok = true;
+    for(size_t i=0; i<arm.nJoints(); i++)
+        ok &= isApprox(arm.joint(i).respectToRobot(), referenceJointPose(hubo, arm.joint(i).id()));
+    check(ok, "Earlier write after a wrist write updates the rest of the chain");
+
+    // Rewriting the current values must not leave anything stale
+    hubo.values(hubo.values());
+    torso.joint(0).value(torso.joint(0).value());
+    check(isApprox(arm.tool().respectToRobot(), referenceToolPose(hubo, leftArm)),
+          "Rewriting unchanged values keeps the frames");
+
+    torso.joint(0).value(-0.5);
+    check(isApprox(arm.tool().respectToRobot(), referenceToolPose(hubo, leftArm)),
+          "Child linkage follows its attachment frame");
+
+    // Fixed transform edits go through the same range
+    arm.tool().respectToRobot();
+    TRANSFORM offset(TRANSFORM::Identity());
+    offset.translate(TRANSLATION(0.02, 0.0, -0.05));
+    arm.joint(5).value(0.1);
+    arm.joint(0).respectToFixed(offset);
+    check(isApprox(arm.tool().respectToRobot(), referenceToolPose(hubo, leftArm)),
+          "Fixed transform edit on the first joint updates the chain");
+
+    arm.tool().respectToFixed(offset);
+    check(isApprox(arm.tool().respectToRobot(), referenceToolPose(hubo, leftArm)),
+          "Tool edit updates the tool");
+
+    return failures == 0;
+}
+
+
+bool worldCacheTest()
+{
+    cout << "-----------------------------" << endl;
+    cout << "| Testing World Frame Cache |" << endl;
+    cout << "-----------------------------" << endl;
+
+    Hubo hubo;
+    hubo.imposeLimits = false;
+
+    VectorXd q;
+    randomValues(hubo, q);
+    hubo.values(q);
+
+    TRANSFORM world(TRANSFORM::Identity());
+    world.rotate(AngleAxisd(0.3, Vector3d::UnitZ()));
+    world.pretranslate(TRANSLATION(1.0, 2.0, 0.5));
+    hubo.respectToWorld(world);
+
+    bool ok = true;
+    for(size_t i=0; i<hubo.nJoints(); i++)
+        ok &= isApprox(hubo.joint(i).respectToWorld(), world*referenceJointPose(hubo, i));
+    for(size_t i=0; i<hubo.nLinkages(); i++)
+        ok &= isApprox(hubo.linkage(i).tool().respectToWorld(), world*referenceToolPose(hubo, i))
+              && isApprox(hubo.linkage(i).respectToWorld(), world*referenceLinkagePose(hubo, i));
+    check(ok, "World frames after moving the robot");
+
+    Joint& hand = hubo.joint("LWP");
+    const TRANSFORM& cached = hand.respectToWorld();
+    check(&cached == &hand.respectToWorld(), "World frames are returned by reference");
+
+    hubo.joint("TOR").value(0.4);
+    check(isApprox(hand.respectToWorld(), world*referenceJointPose(hubo, hand.id())),
+          "Cache follows a joint write in a parent linkage");
+
+    hand.value(hand.value() + 0.2);
+    check(isApprox(hand.respectToWorld(), world*referenceJointPose(hubo, hand.id())),
+          "Cache follows a write to the joint itself");
+
+    world.pretranslate(TRANSLATION(0.0, -1.0, 0.0));
+    hubo.respectToWorld(world);
+    size_t leftArm = hubo.linkageIndex("LEFT_ARM");
+    check(isApprox(hand.respectToWorld(), world*referenceJointPose(hubo, hand.id()))
+          && isApprox(hubo.linkage(leftArm).tool().respectToWorld(), world*referenceToolPose(hubo, leftArm)),
+          "Cache follows Robot::respectToWorld()");
+
+    Joint& foot = hubo.joint("RAR");
+    check(isApprox(hand.respectTo(&foot), referenceJointPose(hubo, foot.id()).inverse()*referenceJointPose(hubo, hand.id())),
+          "Frame::respectTo() uses the current frames");
+
+    return failures == 0;
+}
+
+
+bool relativeTransformTest()
+{
+    cout << "-------------------------------" << endl;
+    cout << "| Testing Relative Transforms |" << endl;
+    cout << "-------------------------------" << endl;
+
+    Hubo hubo;
+    hubo.imposeLimits = false;
+
+    VectorXd q;
+    randomValues(hubo, q);
+    hubo.values(q);
+
+    TRANSFORM world(TRANSFORM::Identity());
+    world.rotate(AngleAxisd(-0.7, Vector3d::UnitX()));
+    world.pretranslate(TRANSLATION(0.3, 0.0, 1.0));
+    hubo.respectToWorld(world);
+
+    // Every kind of frame against every other kind
+    vector<const Frame*> frames;
+    frames.push_back(&hubo);
+    for(size_t i=0; i<hubo.nLinkages(); i++)
+    {
+        frames.push_back(&hubo.linkage(i));
+        frames.push_back(&hubo.linkage(i).tool());
+    }
+    for(size_t i=0; i<hubo.nJoints(); i+=3)
+        frames.push_back(&hubo.joint(i));
+
+    bool ok = true;
+    for(size_t i=0; i<frames.size(); i++)
+        for(size_t j=0; j<frames.size(); j++)
+            ok &= isApprox(frames[i]->respectTo(frames[j]),
+                           frames[j]->respectToWorld().inverse()*frames[i]->respectToWorld());
+    check(ok, "Tree path matches the world frame path");
+
+    const Linkage& torso = hubo.linkage("TORSO");
+    const Linkage& leftArm = hubo.linkage("LEFT_ARM");
+    const Linkage& rightLeg = hubo.linkage("RIGHT_LEG");
+    check(RelativeTransforms::lowestCommonAncestor(&leftArm, &hubo.linkage("RIGHT_ARM")) == &torso
+          && RelativeTransforms::lowestCommonAncestor(&leftArm, &torso) == &torso
+          && RelativeTransforms::lowestCommonAncestor(&leftArm, &rightLeg) == NULL,
+          "Lowest common ancestors");
+
+    RelativeTransforms relative;
+    Joint& hand = hubo.joint("LWP");
+    Joint& otherHand = hubo.joint("RWP");
+    Joint& foot = hubo.joint("RAR");
+    size_t hands = relative.addPair(hand, otherHand);
+    size_t handFoot = relative.addPair(hand, foot);
+
+    const TRANSFORM& cached = relative.pair(hands);
+    check(&cached == &relative.pair(hands) && isApprox(cached, hand.respectTo(&otherHand)),
+          "Cached pair matches Frame::respectTo()");
+
+    // The torso joint is above both hands, so the pair keeps its value
+    TRANSFORM before = relative.pair(hands);
+    hubo.joint("TOR").value(hubo.joint("TOR").value() + 0.3);
+    check(isApprox(relative.pair(hands), before)
+          && isApprox(relative.pair(handFoot), hand.respectTo(&foot)),
+          "Pairs follow a joint above them");
+
+    hand.value(hand.value() - 0.4);
+    hubo.joint("RAP").value(0.8);
+    check(isApprox(relative.pair(hands), hand.respectTo(&otherHand))
+          && isApprox(relative.pair(handFoot), hand.respectTo(&foot)),
+          "Pairs follow joints on their path");
+
+    TRANSFORM offset(TRANSFORM::Identity());
+    offset.translate(TRANSLATION(0.0, 0.1, 0.0));
+    hubo.linkage("RIGHT_ARM").respectToFixed(offset);
+    check(isApprox(relative.pair(hands), otherHand.respectToWorld().inverse()*hand.respectToWorld()),
+          "Pairs follow fixed transform edits on their path");
+
+    return failures == 0;
+}
+
+
+bool deepTreeTest()
+{
+    cout << "--------------------------------" << endl;
+    cout << "| Testing Deep Kinematic Trees |" << endl;
+    cout << "--------------------------------" << endl;
+
+    // A chain of linkages given deepest first, so every child comes before
+    // its parent, plus a leaf hanging off the middle of the chain
+    size_t depth = 200;
+    TRANSFORM offset(TRANSFORM::Identity());
+    offset.translate(TRANSLATION(0.1, 0.0, 0.02));
+    offset.rotate(AngleAxisd(0.2, Vector3d::UnitX()));
+
+    vector<Linkage> linkages;
+    vector<int> parents;
+    for(size_t i=0; i<=depth; i++)
+    {
+        size_t level = depth-i;
+        stringstream name;
+        name << "L" << level;
+        vector<Joint> joints(1, Joint(offset, name.str()+"_J", 0, REVOLUTE, AXIS::UnitZ()));
+        linkages.push_back(Linkage(offset, name.str(), 0, joints, Tool(offset)));
+        parents.push_back(level == 0 ? -1 : (int)i+1);
+    }
+    vector<Joint> leafJoints(1, Joint(offset, "LEAF_J", 0, REVOLUTE, AXIS::UnitY()));
+    linkages.insert(linkages.begin(), Linkage(offset, "LEAF", 0, leafJoints, Tool(offset)));
+    for(size_t i=0; i<parents.size(); i++)
+        if(parents[i] >= 0)
+            parents[i]++;
+    parents.insert(parents.begin(), (int)(depth/2)+1);
+
+    Robot robot(linkages, parents);
+    check(robot.nLinkages() == depth+2, "Every linkage is added");
+
+    bool ok = true;
+    for(size_t i=0; i<robot.nLinkages(); i++)
+    {
+        Linkage& linkage = robot.linkage(i);
+        if(linkage.getParentLinkageName() != "")
+            ok &= robot.linkageIndex(linkage.getParentLinkageName()) < i;
+    }
+    ok &= robot.linkage("L1").getParentLinkageName() == "L0"
+          && robot.linkage("LEAF").getParentLinkageName() == "L100";
+    check(ok, "Parents come before their children and keep their names");
+
+    VectorXd q;
+    randomValues(robot, q);
+    robot.values(q);
+    size_t deepest = robot.linkageIndex("L200");
+    size_t leaf = robot.linkageIndex("LEAF");
+    check(isApprox(robot.linkage(deepest).tool().respectToRobot(), referenceToolPose(robot, deepest), 1e-8)
+          && isApprox(robot.linkage(leaf).tool().respectToRobot(), referenceToolPose(robot, leaf), 1e-8),
+          "Lazy query at the bottom of a deep tree");
+
+    robot.joint("L0_J").value(0.3);
+    robot.updateFrames();
+    ok = true;
+    for(size_t i=0; i<robot.nLinkages(); i++)
+        ok &= isApprox(robot.linkage(i).tool().respectToRobot(), referenceToolPose(robot, i), 1e-8);
+    check(ok, "Single sweep after moving the root");
+
+    return failures == 0;
+}
+
+
+bool collapseAnchorsTest()
+{
+    cout << "-----------------------------" << endl;
+    cout << "| Testing Anchor Collapsing |" << endl;
+    cout << "-----------------------------" << endl;
+
+    TRANSFORM a(TRANSFORM::Identity()), b(TRANSFORM::Identity());
+    a.translate(TRANSLATION(0.1, 0.02, 0.0));
+    a.rotate(AngleAxisd(0.3, Vector3d::UnitY()));
+    b.translate(TRANSLATION(0.0, -0.05, 0.2));
+    b.rotate(AngleAxisd(-0.6, Vector3d(1, 1, 0).normalized()));
+
+    Matrix3d tensor;
+    tensor << 0.02, 0.001, 0.0,
+              0.001, 0.03, 0.002,
+              0.0, 0.002, 0.01;
+
+    // Leading, consecutive and trailing anchors around two revolute joints
+    JointType types[] = { ANCHOR, REVOLUTE, ANCHOR, ANCHOR, REVOLUTE, ANCHOR };
+    const char* names[] = { "MOUNT", "J1", "CAMERA", "CAMERA_OPTICAL", "J2", "FLANGE" };
+    vector<Joint> joints;
+    for(size_t i=0; i<6; i++)
+    {
+        joints.push_back(Joint(i%2 ? a : b, names[i], i, types[i], AXIS(0, 1, 1)));
+        joints.back().link = Link(0.5+0.1*i, TRANSLATION(0.01*i, 0.02, -0.01), tensor);
+    }
+    Tool tool(a);
+    tool.massProperties = Link(0.3, TRANSLATION(0.0, 0.0, 0.05), tensor);
+
+    vector<Joint> childJoints;
+    childJoints.push_back(Joint(b, "SENSOR", 0, ANCHOR));
+    childJoints.back().link = Link(0.2, TRANSLATION(0.03, 0.0, 0.0), tensor);
+    childJoints.push_back(Joint(a, "FINGER", 1, PRISMATIC, AXIS::UnitX()));
+
+    vector<Linkage> linkages;
+    linkages.push_back(Linkage(b, "ARM", 0, joints, tool));
+    linkages.push_back(Linkage(a, "HAND", 1, childJoints, Tool(b)));
+    vector<int> parents;
+    parents.push_back(-1);
+    parents.push_back(0);
+    Robot robot(linkages, parents);
+    robot.rootLink = Link(2.0, TRANSLATION(0.0, 0.0, -0.1), tensor);
+    robot.joint("J1").value(0.4);
+    robot.joint("J2").value(-0.7);
+    robot.joint("FINGER").value(0.05);
+
+    vector<TRANSFORM> anchors;
+    for(size_t i=0; i<6; i++)
+        if(types[i] == ANCHOR)
+            anchors.push_back(robot.joint(names[i]).respectToRobot());
+    anchors.push_back(robot.joint("SENSOR").respectToRobot());
+    TRANSFORM hand = robot.linkage("HAND").tool().respectToRobot();
+    TRANSFORM finger = robot.joint("FINGER").respectToRobot();
+    TRANSLATION comBefore, comAfter;
+    Matrix3d inertiaBefore = robotInertia(robot, comBefore);
+    double massBefore = robot.mass();
+
+    size_t removed = robot.collapseAnchors();
+    check(removed == 5 && robot.nJoints() == 3 && robot.linkage("ARM").nJoints() == 2
+          && robot.joint(2).name() == "FINGER" && robot.jointIndex("FINGER") == 2
+          && robot.linkage("ARM").joint("J2").localID() == 1,
+          "Anchors are removed and the joints renumbered");
+
+    check(isApprox(robot.linkage("HAND").tool().respectToRobot(), hand)
+          && isApprox(robot.joint("FINGER").respectToRobot(), finger),
+          "Frames do not move");
+
+    bool ok = true;
+    size_t k = 0;
+    for(size_t i=0; i<6; i++)
+        if(types[i] == ANCHOR)
+            ok &= robot.isCollapsed(names[i]) && isApprox(robot.collapsedRespectTo(names[i], &robot), anchors[k++]);
+    ok &= isApprox(robot.collapsedRespectTo("SENSOR", &robot), anchors[k]);
+    ok &= robot.collapsedFrame("MOUNT").host == &robot.linkage("ARM")
+          && robot.collapsedFrame("FLANGE").host == &robot.joint("J2");
+    check(ok, "Removed frames resolve through their host");
+
+    Matrix3d inertiaAfter = robotInertia(robot, comAfter);
+    check(fabs(robot.mass() - massBefore) < 1e-12 && (comAfter - comBefore).norm() < 1e-12
+          && (inertiaAfter - inertiaBefore).norm() < 1e-12,
+          "Mass, center of mass and inertia are kept");
+
+    robot.joint("J1").value(-0.2);
+    robot.joint("FINGER").value(0.01);
+    MatrixXd J;
+    vector<Joint*> movable(robot.joints().begin(), robot.joints().end());
+    robot.jacobian(J, movable, robot.joint("FINGER").respectToRobot().translation(), &robot);
+    check(J.cols() == 3 && J.col(0).norm() > 0 && J.col(1).norm() > 0 && J.col(2).norm() > 0,
+          "The Jacobian only has movable joints");
+
+    return failures == 0;
+}
+
+
+bool arenaTest()
+{
+    cout << "-------------------------" << endl;
+    cout << "| Testing Arena Storage |" << endl;
+    cout << "-------------------------" << endl;
+
+    Arena<Joint> arena(4);
+    vector<Joint*> created;
+    for(size_t i=0; i<10; i++)
+        created.push_back(arena.create(Joint(TRANSFORM::Identity(), "J", i, REVOLUTE)));
+    bool ok = arena.size() == 10;
+    for(size_t i=1; i<4; i++)
+        ok &= created[i] == created[i-1]+1;
+    for(size_t i=0; i<created.size(); i++)
+        ok &= (size_t)created[i] % 16 == 0 && created[i]->id() == i;
+    check(ok, "Objects are contiguous, aligned and keep their values");
+
+    // Robots built and torn down one after the other
+    ok = true;
+    for(size_t n=0; n<5; n++)
+    {
+        Hubo hubo;
+        for(size_t i=0; i<hubo.nJoints(); i++)
+            ok &= (size_t)&hubo.joint(i) % 16 == 0;
+        for(size_t i=0; i<hubo.nLinkages(); i++)
+        {
+            ok &= (size_t)&hubo.linkage(i) % 16 == 0;
+            for(size_t j=1; j<hubo.linkage(i).nJoints(); j++)
+                ok &= &hubo.linkage(i).joint(j) > &hubo.linkage(i).joint(j-1);
+        }
+
+        VectorXd q;
+        randomValues(hubo, q);
+        hubo.values(q);
+        for(size_t i=0; i<hubo.nLinkages(); i++)
+            ok &= isApprox(hubo.linkage(i).tool().respectToRobot(), referenceToolPose(hubo, i));
+    }
+    check(ok, "Frames of repeatedly built robots are aligned and correct");
+
+    return failures == 0;
+}
+
+
+bool handleTest()
+{
+    cout << "-----------------------------------" << endl;
+    cout << "| Testing Handles and Name Tables |" << endl;
+    cout << "-----------------------------------" << endl;
+
+    // Enough names to rehash a few times, with erasures in between
+    NameTable table;
+    bool ok = true;
+    for(size_t i=0; i<200; i++)
+    {
+        stringstream name;
+        name << "F" << i;
+        table.insert(name.str(), i);
+        if(i % 3 == 0)
+            ok &= table.erase(name.str());
+    }
+    for(size_t i=0; i<200; i++)
+    {
+        stringstream name;
+        name << "F" << i;
+        ok &= table.find(name.str()) == (i % 3 == 0 ? NameTable::npos : i);
+    }
+    table.insert("F1", 7);
+    ok &= table.find("F1") == 7 && table.size() == 133 && !table.erase("F0");
+    check(ok, "Name table insert, replace, erase and find");
+
+    Hubo hubo;
+    JointHandle lep = hubo.jointHandle("LEP");
+    LinkageHandle arm = hubo.linkageHandle("RIGHT_ARM");
+    check(hubo.isValid(lep) && &hubo.joint(lep) == &hubo.joint("LEP")
+          && hubo.isValid(arm) && &hubo.linkage(arm) == &hubo.linkage("RIGHT_ARM")
+          && !hubo.isValid(hubo.jointHandle("NOT_A_JOINT")),
+          "Handles resolve to the named frames");
+
+    hubo.setJointValue(lep, -0.4);
+    check(hubo.joint("LEP").value() == -0.4, "Joint values through handles");
+
+    JointGroupHandle armJoints = hubo.jointGroupHandle(arm);
+    bool same = armJoints.indices.size() == hubo.linkage(arm).nJoints();
+    for(size_t i=0; same && i<armJoints.indices.size(); i++)
+        same &= armJoints.indices[i] == hubo.linkage(arm).joint(i).id();
+    check(same, "Linkage groups hold the joints of the linkage");
+
+    VectorXd goal = VectorXd::Constant(armJoints.indices.size(), 0.2);
+    hubo.values(armJoints, goal);
+    TRANSFORM target = hubo.linkage(arm).tool().respectToRobot();
+
+    VectorXd byName = VectorXd::Zero(goal.size()), byHandle = VectorXd::Zero(goal.size());
+    Constraints nameConstraints, handleConstraints;
+    hubo.values(VectorXd::Zero(hubo.nJoints()));
+    hubo.dampedLeastSquaresIK_linkage("RIGHT_ARM", byName, target, nameConstraints);
+    hubo.values(VectorXd::Zero(hubo.nJoints()));
+    hubo.dampedLeastSquaresIK(armJoints, byHandle, target, handleConstraints);
+    check((byName - byHandle).norm() < 1e-12 && (hubo.values(armJoints) - byHandle).norm() < 1e-12,
+          "Solvers give the same result for names and handles");
+
+    hubo.joint(lep).name("LEFT_ELBOW");
+    check(hubo.jointIndex("LEFT_ELBOW") == lep.index && hubo.isValid(lep),
+          "Renamed joints are found under their new name");
+
+    hubo.addLinkage(Linkage(), (int)hubo.linkageIndex("RIGHT_ARM"), "RIGHT_GRIPPER");
+    check(!hubo.isValid(lep) && !hubo.isValid(armJoints)
+          && hubo.isValid(hubo.jointHandle("LEFT_ELBOW")),
+          "Handles are stale once the robot changes");
+
+    return failures == 0;
+}
+
+
+bool invalidLookupTest()
+{
+    cout << "---------------------------" << endl;
+    cout << "| Testing Invalid Lookups |" << endl;
+    cout << "---------------------------" << endl;
+
+    Hubo hubo;
+    Joint& first = hubo.joint("NOT_A_JOINT");
+    first.value(0.5);
+    Joint& second = hubo.joint(hubo.nJoints());
+    check(&first == &second && second.name() == "invalid" && second.value() == 0,
+          "Invalid joints are one shared, reset sentinel");
+
+    Linkage& linkage = hubo.linkage("NOT_A_LINKAGE");
+    check(&linkage == &hubo.linkage(hubo.nLinkages()) && &linkage == &hubo.linkage("TORSO").parentLinkage()
+          && linkage.name() == "invalid" && linkage.nJoints() == 0,
+          "Invalid linkages are one shared sentinel");
+
+    hubo.linkage("NOT_A_LINKAGE").addJoint(Joint(TRANSFORM::Identity(), "EXTRA"));
+    Linkage& reset = hubo.linkage("NOT_A_LINKAGE");
+    check(reset.nJoints() == 0 && reset.joint("EXTRA").name() == "invalid",
+          "Invalid linkages forget the names of their joints");
+
+    const Hubo& constHubo = hubo;
+    check(&constHubo.const_joint("NOT_A_JOINT") == &Joint::ConstInvalid()
+          && &constHubo.const_joint(hubo.nJoints()) == &Joint::ConstInvalid()
+          && constHubo.const_joint("NOT_A_JOINT").name() == "invalid"
+          && &constHubo.const_linkage(LinkageHandle()) == &Linkage::ConstInvalid(),
+          "Failed const lookups return the read-only sentinels");
+
+    Joint loose;
+    check(&loose.robot() == &Robot::Invalid() && loose.robot().name() == "invalid"
+          && &Robot::Default() == &Robot::Default(),
+          "Robot sentinels are shared");
+
+    TRANSFORM moved = TRANSFORM::Identity();
+    moved.translate(TRANSLATION(1, 2, 3));
+    loose.robot().respectToWorld(moved);
+    check(isApprox(loose.robot().respectToWorld(), TRANSFORM::Identity()),
+          "The invalid robot is rebuilt between lookups");
+
+    check(isApprox(hubo.collapsedRespectTo("NOT_A_FRAME", &hubo), TRANSFORM::Identity()),
+          "Unknown collapsed frames resolve to the robot");
+
+    Constraints defaults = Constraints::Defaults();
+    defaults.finalTransform.translate(TRANSLATION(1, 0, 0));
+    check(Constraints::Defaults().finalTransform.isApprox(TRANSFORM::Identity()),
+          "Default constraints are copies");
+
+    VectorXd goal = VectorXd::Constant(hubo.linkage("LEFT_ARM").nJoints(), 0.2);
+    hubo.linkage("LEFT_ARM").values(goal);
+    TRANSFORM target = hubo.linkage("LEFT_ARM").tool().respectToRobot();
+    VectorXd implicit = VectorXd::Zero(goal.size()), byDefaults = VectorXd::Zero(goal.size());
+    Constraints constraints;
+    hubo.values(VectorXd::Zero(hubo.nJoints()));
+    hubo.dampedLeastSquaresIK_linkage("LEFT_ARM", implicit, target);
+    hubo.values(VectorXd::Zero(hubo.nJoints()));
+    hubo.dampedLeastSquaresIK_linkage("LEFT_ARM", byDefaults, target, constraints);
+    check((implicit - byDefaults).norm() < 1e-12, "Solvers without constraints use the defaults");
+
+    return failures == 0;
+}
+
+
+bool cloneTest()
+{
+    cout << "-------------------------" << endl;
+    cout << "| Testing Robot Cloning |" << endl;
+    cout << "-------------------------" << endl;
+
+    Hubo hubo;
+    VectorXd q;
+    randomValues(hubo, q);
+    hubo.values(q);
+    hubo.linkage("LEFT_ARM").tool().respectToRobot();
+    hubo.collapseAnchors();
+
+    Robot* copy = hubo.clone();
+    bool ok = copy->nJoints() == hubo.nJoints() && copy->nLinkages() == hubo.nLinkages()
+              && copy->values() == hubo.values();
+    for(size_t i=0; i<hubo.nJoints(); i++)
+        ok &= &copy->joint(i) != &hubo.joint(i) && copy->joint(i).name() == hubo.joint(i).name()
+              && &copy->joint(i).robot() == copy && isApprox(copy->joint(i).respectToRobot(), hubo.joint(i).respectToRobot());
+    for(size_t i=0; i<hubo.nLinkages(); i++)
+        ok &= copy->linkage(i).getParentLinkageName() == hubo.linkage(i).getParentLinkageName()
+              && copy->linkage(i).nChildren() == hubo.linkage(i).nChildren()
+              && isApprox(copy->linkage(i).tool().respectToRobot(), hubo.linkage(i).tool().respectToRobot());
+    check(ok, "Clone has the same structure, values and frames");
+
+    check(copy->jointIndex("LEP") == hubo.jointIndex("LEP")
+          && &copy->joint("LEP") == &copy->joint(hubo.jointIndex("LEP"))
+          && copy->isValid(copy->jointHandle("LEP")) && !copy->isValid(hubo.jointHandle("LEP")),
+          "Clone has its own name lookups and handles");
+
+    TRANSFORM hand = hubo.linkage("LEFT_ARM").tool().respectToRobot();
+    TRANSFORM offset = copy->joint("LEP").respectToFixed();
+    offset.translate(TRANSLATION(0.0, 0.0, 0.1));
+    copy->joint("LEP").respectToFixed(offset);
+    copy->joint("LSP").value(copy->joint("LSP").value() + 0.2);
+    check(isApprox(hubo.linkage("LEFT_ARM").tool().respectToRobot(), hand)
+          && !isApprox(copy->linkage("LEFT_ARM").tool().respectToRobot(), hand)
+          && isApprox(copy->linkage("LEFT_ARM").tool().respectToRobot(),
+                      referenceToolPose(*copy, copy->linkageIndex("LEFT_ARM"))),
+          "Edits to the clone stay in the clone");
+
+    ok = true;
+    for(size_t i=0; i<hubo.nLinkages(); i++)
+        ok &= isApprox(hubo.linkage(i).tool().respectToRobot(), referenceToolPose(hubo, i));
+    check(ok, "The original is untouched");
+
+    delete copy;
+
+    Robot* base = &hubo;
+    Robot* polymorphic = base->clone();
+    Hubo* huboCopy = dynamic_cast<Hubo*>(polymorphic);
+    ok = huboCopy != NULL;
+    if(ok)
+    {
+        TRANSFORM B, copyB;
+        SCREW armValues;
+        armValues << 0.1, -0.2, 0.3, -0.4, 0.5, -0.6;
+        hubo.armFK(B, armValues, SIDE_RIGHT);
+        huboCopy->armFK(copyB, armValues, SIDE_RIGHT);
+        ok = isApprox(B, copyB) && huboCopy->armLengths == hubo.armLengths
+             && huboCopy->values() == hubo.values();
+    }
+    check(ok, "Cloning through a Robot pointer keeps the Hubo");
+    delete polymorphic;
+
+    Hubo second(hubo);
+    check(second.values() == hubo.values()
+          && isApprox(second.linkage("RIGHT_LEG").tool().respectToWorld(),
+                      hubo.linkage("RIGHT_LEG").tool().respectToWorld()),
+          "Copy construction");
+
+    return failures == 0;
+}
+
+
+bool snapshotTest()
+{
+    cout << "---------------------------" << endl;
+    cout << "| Testing Robot Snapshots |" << endl;
+    cout << "---------------------------" << endl;
+
+    Hubo hubo;
+    VectorXd q;
+    randomValues(hubo, q);
+    hubo.values(q);
+    hubo.linkage("TORSO").tool().respectToRobot();
+
+    vector<TRANSFORM> tools(hubo.nLinkages());
+    for(size_t i=0; i<hubo.nLinkages(); i++)
+        tools[i] = hubo.linkage(i).tool().respectToWorld();
+
+    RobotSnapshot all;
+    hubo.snapshot(all);
+    check(all.nJoints() == hubo.nJoints() && all.nLinkages() == hubo.nLinkages(), "Full snapshot size");
+
+    VectorXd q2;
+    randomValues(hubo, q2);
+    hubo.values(q2);
+    hubo.imposeLimits = false;
+    hubo.linkage("RIGHT_LEG").tool().respectToWorld();
+    check(hubo.restore(all) && hubo.values() == q && hubo.imposeLimits, "Restore full snapshot");
+
+    bool ok = true;
+    for(size_t i=0; i<hubo.nLinkages(); i++)
+        ok &= isApprox(hubo.linkage(i).tool().respectToWorld(), tools[i])
+              && isApprox(hubo.linkage(i).tool().respectToRobot(), referenceToolPose(hubo, i));
+    check(ok, "Frames after restoring a full snapshot");
+
+    RobotSnapshot torso;
+    hubo.snapshot(torso, hubo.linkageIndex("TORSO"));
+    check(torso.nLinkages() == 3 && torso.nJoints() == hubo.linkage("TORSO").nJoints()
+          + hubo.linkage("LEFT_ARM").nJoints() + hubo.linkage("RIGHT_ARM").nJoints(),
+          "Snapshot of the torso covers the arms");
+
+    RobotSnapshot arm;
+    hubo.snapshot(arm, hubo.linkageIndex("LEFT_ARM"));
+    check(arm.nLinkages() == 1 && arm.nJoints() == hubo.linkage("LEFT_ARM").nJoints(), "Partial snapshot size");
+
+    hubo.joint("LSP").value(hubo.joint("LSP").value() + 0.3);
+    hubo.linkage("LEFT_ARM").tool().respectToRobot();
+    hubo.joint("LEP").value(hubo.joint("LEP").value() - 0.2);
+    ok = hubo.restore(arm) && hubo.values() == q;
+    for(size_t i=0; i<hubo.nLinkages(); i++)
+        ok &= isApprox(hubo.linkage(i).tool().respectToWorld(), tools[i]);
+    check(ok, "Restore partial snapshot");
+
+    // The parent of a partial snapshot changes before the restore
+    hubo.snapshot(arm, hubo.linkageIndex("LEFT_ARM"));
+    hubo.linkage("TORSO").joint(0).value(0.8);
+    ok = hubo.restore(arm);
+    Hubo fresh;
+    fresh.imposeLimits = hubo.imposeLimits;
+    fresh.values(hubo.values());
+    ok &= isApprox(hubo.linkage("LEFT_ARM").tool().respectToRobot(),
+                   fresh.linkage("LEFT_ARM").tool().respectToRobot());
+    hubo.linkage("TORSO").joint(0).value(-0.3);
+    fresh.linkage("TORSO").joint(0).value(-0.3);
+    ok &= isApprox(hubo.linkage("LEFT_ARM").tool().respectToRobot(),
+                   fresh.linkage("LEFT_ARM").tool().respectToRobot());
+    hubo.values(q);
+    check(ok, "Restore partial snapshot after its parent changed");
+
+    TRANSFORM B;
+    SCREW armValues;
+    armValues << 0.1, -0.2, 0.3, -0.4, 0.5, -0.6;
+    hubo.armFK(B, armValues, SIDE_LEFT);
+    ok = hubo.values() == q;
+    for(size_t i=0; i<hubo.nLinkages(); i++)
+        ok &= isApprox(hubo.linkage(i).tool().respectToWorld(), tools[i]);
+    check(ok, "armFK() leaves the robot as it was");
+
+    // The geometry changes after the snapshot
+    hubo.snapshot(all);
+    TRANSFORM original = hubo.joint("LEP").respectToFixed();
+    TRANSFORM shifted = original;
+    shifted.pretranslate(TRANSLATION(0.0, 0.0, 0.05));
+    hubo.joint("LEP").respectToFixed(shifted);
+    ok = !hubo.restore(all);
+    ok &= isApprox(hubo.linkage("LEFT_ARM").tool().respectToRobot(),
+                   referenceToolPose(hubo, hubo.linkageIndex("LEFT_ARM")));
+    hubo.joint("LEP").respectToFixed(original);
+    check(ok, "Snapshot taken before a geometry change is rejected");
+
+    hubo.addLinkage(Linkage(), (int)hubo.linkageIndex("LEFT_ARM"), "LEFT_GRIPPER");
+    check(!hubo.restore(all), "Stale snapshot is rejected");
+
+    return failures == 0;
+}
+
+
+bool jacobianWorkspaceTest()
+{
+    cout << "-------------------------------" << endl;
+    cout << "| Testing Jacobian Workspaces |" << endl;
+    cout << "-------------------------------" << endl;
+
+    Hubo hubo;
+    VectorXd q;
+    randomValues(hubo, q);
+    hubo.values(q);
+    hubo.respectToWorld(TRANSFORM(AngleAxisd(0.7, AXIS(1.0, 2.0, 3.0).normalized())));
+
+    Linkage& arm = hubo.linkage("LEFT_ARM");
+    const vector<Joint*>& joints = arm.const_joints();
+    size_t n = joints.size();
+    TRANSLATION location = arm.tool().respectToRobot().translation();
+
+    MatrixXd J;
+    hubo.jacobian(J, joints, location, &hubo);
+    Matrix6Xd workspace(6, n+2);
+    workspace.setConstant(7.0);
+    hubo.jacobian(workspace.middleCols(1, n), joints, location, &hubo);
+    check(workspace.middleCols(1, n).isApprox(J, 1e-12)
+          && (workspace.col(0).array() == 7.0).all() && (workspace.col(n+1).array() == 7.0).all(),
+          "Robot Jacobian written into a block of a workspace");
+
+    const Frame* torso = &hubo.linkage("TORSO");
+    Matrix3d r = torso->respectToWorld().rotation().transpose() * hubo.respectToWorld().rotation();
+    MatrixXd R(6,6);
+    R << r, Matrix3d::Zero(), Matrix3d::Zero(), r;
+    MatrixXd expected = R*J;
+    hubo.jacobian(J, joints, location, torso);
+    Matrix6Xd Jw(6, n);
+    hubo.jacobian(Jw, joints, location, torso);
+    check(J.isApprox(expected, 1e-12) && Jw.isApprox(expected, 1e-12), "Robot Jacobian in another frame");
+
+    TRANSLATION local = arm.const_tool().respectToLinkage().translation();
+    arm.jacobian(J, local, &arm);
+    arm.jacobian(Jw, local, &arm);
+    bool ok = Jw.isApprox(J, 1e-12);
+    arm.jacobian(J, local, &hubo);
+    arm.jacobian(Jw, joints, local, &hubo);
+    ok &= Jw.isApprox(J, 1e-12);
+    hubo.jacobian(expected, joints, location, &hubo);
+    check(ok && J.isApprox(expected, 1e-10), "Linkage Jacobian workspaces");
+
+    return failures == 0;
+}
+
+
+bool frameJacobianTest()
+{
+    cout << "---------------------------" << endl;
+    cout << "| Testing Frame Jacobians |" << endl;
+    cout << "---------------------------" << endl;
+
+    Hubo hubo;
+    VectorXd q;
+    randomValues(hubo, q);
+    hubo.values(q);
+
+    const Tool& hand = hubo.linkage("LEFT_ARM").const_tool();
+    TRANSLATION point(0.01, -0.02, 0.05);
+    FrameJacobian sparse;
+    hubo.frameJacobian(sparse, hand, point, &hubo);
+
+    size_t nExpected = hubo.linkage("TORSO").nJoints() + hubo.linkage("LEFT_ARM").nJoints();
+    bool ok = sparse.jointIndices.size() == nExpected && sparse.J.cols() == (int)nExpected
+              && sparse.jointIndices.front() == hubo.jointIndex("TOR");
+    for(size_t i=1; i<sparse.jointIndices.size(); i++)
+        ok &= sparse.jointIndices[i] > sparse.jointIndices[i-1];
+    check(ok, "Left hand Jacobian spans the torso and the left arm");
+
+    MatrixXd expected;
+    hubo.jacobian(expected, sparse.joints, hand.respectToRobot()*point, &hubo);
+    check(sparse.J.isApprox(expected, 1e-12), "Columns match Robot::jacobian()");
+
+    // Finite differences over the full joint vector
+    hubo.imposeLimits = false;
+    MatrixXd J;
+    hubo.frameJacobian(J, hand, point, &hubo);
+    MatrixXd numeric(6, hubo.nJoints());
+    double h = 1e-6;
+    TRANSFORM pose0 = hand.respectToRobot();
+    for(size_t j=0; j<hubo.nJoints(); j++)
+    {
+        VectorXd qh = q;
+        qh[j] += h;
+        hubo.values(qh);
+        TRANSFORM pose = hand.respectToRobot();
+        numeric.block<3,1>(0,j) = (pose*point - pose0*point)/h;
+        AngleAxisd w(pose.rotation()*pose0.rotation().transpose());
+        numeric.block<3,1>(3,j) = w.angle()*w.axis()/h;
+    }
+    hubo.values(q);
+    check(J.rows() == 6 && J.cols() == (int)hubo.nJoints() && (J-numeric).norm() < 1e-4,
+          "Dense Jacobian matches finite differences, with zero columns for other limbs");
+
+    hubo.frameJacobian(sparse, hubo.linkage("RIGHT_LEG"), TRANSLATION::Zero(), &hubo);
+    check(sparse.jointIndices.empty(), "Root linkage frame is not moved by any joint");
+
+    hubo.frameJacobian(sparse, hubo.joint("LEP"), point, &hubo);
+    check(sparse.jointIndices.back() == hubo.jointIndex("LEP")
+          && sparse.jointIndices.size() == hubo.linkage("TORSO").nJoints() + hubo.joint("LEP").localID()+1,
+          "Joint frame Jacobian stops at the joint");
+
+    return failures == 0;
+}
+
+
+bool jacobianDotTest()
+{
+    cout << "--------------------------------" << endl;
+    cout << "| Testing Jacobian Derivatives |" << endl;
+    cout << "--------------------------------" << endl;
+
+    Hubo hubo;
+    hubo.imposeLimits = false;
+    VectorXd q;
+    randomValues(hubo, q);
+    hubo.values(q);
+
+    // Left hand chain including the torso, listed tip first
+    FrameJacobian chain;
+    const Tool& hand = hubo.linkage("LEFT_ARM").const_tool();
+    hubo.frameJacobian(chain, hand, TRANSLATION::Zero(), &hubo);
+    vector<size_t> indices(chain.jointIndices.rbegin(), chain.jointIndices.rend());
+
+    VectorXd qdot(indices.size());
+    for(int i=0; i<qdot.size(); i++)
+        qdot[i] = 0.5 - (double)rand()/RAND_MAX;
+
+    const Frame* frames[2] = { &hubo, &hubo.linkage("TORSO") };
+    for(size_t f=0; f<2; f++)
+    {
+        MatrixXd J, Jdot, reference;
+        hubo.jacobianDot(J, Jdot, indices, qdot, hand.respectToRobot().translation(), frames[f]);
+
+        vector<Joint*> joints;
+        for(size_t i=0; i<indices.size(); i++)
+            joints.push_back(&hubo.joint(indices[i]));
+        hubo.jacobian(reference, joints, hand.respectToRobot().translation(), frames[f]);
+        check(J.isApprox(reference, 1e-12), "J from the same pass matches jacobian()");
+
+        if(f == 1)
+            break; // The torso moves, so only the robot frame has a true derivative
+
+        // Central differences along qdot
+        double h = 1e-6;
+        MatrixXd Jplus, Jminus;
+        VectorXd qh = q;
+        for(size_t i=0; i<indices.size(); i++)
+            qh[indices[i]] += h*qdot[i];
+        hubo.values(qh);
+        hubo.jacobian(Jplus, joints, hand.respectToRobot().translation(), frames[f]);
+        qh = q;
+        for(size_t i=0; i<indices.size(); i++)
+            qh[indices[i]] -= h*qdot[i];
+        hubo.values(qh);
+        hubo.jacobian(Jminus, joints, hand.respectToRobot().translation(), frames[f]);
+        hubo.values(q);
+
+        MatrixXd numeric = (Jplus - Jminus)/(2*h);
+        check((Jdot - numeric).norm() < 1e-6, "Jdot matches finite differences");
+    }
+
+    MatrixXd Jdot;
+    hubo.jacobianDot(Jdot, indices, VectorXd::Zero(indices.size()), TRANSLATION::Zero(), &hubo);
+    check(Jdot.isZero(), "Jdot vanishes at rest");
+
+    return failures == 0;
+}
+
+
+bool hessianTest()
+{
+    cout << "------------------------------" << endl;
+    cout << "| Testing Kinematic Hessians |" << endl;
+    cout << "------------------------------" << endl;
+
+    Hubo hubo;
+    hubo.imposeLimits = false;
+    VectorXd q;
+    randomValues(hubo, q);
+    hubo.values(q);
+
+    FrameJacobian chain;
+    const Tool& foot = hubo.linkage("RIGHT_LEG").const_tool();
+    const Tool& hand = hubo.linkage("LEFT_ARM").const_tool();
+    const Tool* tools[2] = { &foot, &hand };
+    // The torso does not move with the right leg, so it is a fixed frame
+    // for the leg's Hessian
+    const Frame* frames[2] = { &hubo.linkage("TORSO"), &hubo };
+
+    for(size_t t=0; t<2; t++)
+    {
+        hubo.frameJacobian(chain, *tools[t], TRANSLATION::Zero(), &hubo);
+        const vector<size_t>& indices = chain.jointIndices;
+        const vector<Joint*>& joints = chain.joints;
+
+        vector<Matrix6Xd> H;
+        const Frame* reference = frames[t];
+        hubo.hessian(H, indices, tools[t]->respectToRobot().translation(), reference);
+
+        // Central differences in each joint
+
+        double h = 1e-6;
+        bool ok = H.size() == indices.size();
+        for(size_t j=0; j<indices.size() && ok; j++)
+        {
+            MatrixXd Jplus, Jminus;
+            VectorXd qh = q;
+            qh[indices[j]] += h;
+            hubo.values(qh);
+            hubo.jacobian(Jplus, joints, tools[t]->respectToRobot().translation(), reference);
+            qh[indices[j]] -= 2*h;
+            hubo.values(qh);
+            hubo.jacobian(Jminus, joints, tools[t]->respectToRobot().translation(), reference);
+            ok &= (H[j] - (Jplus - Jminus)/(2*h)).norm() < 1e-6;
+        }
+        hubo.values(q);
+        check(ok, t == 0 ? "Right leg Hessian matches finite differences"
+                         : "Left arm and torso Hessian matches finite differences");
+
+        VectorXd qdot(indices.size());
+        for(int i=0; i<qdot.size(); i++)
+            qdot[i] = 0.5 - (double)rand()/RAND_MAX;
+        MatrixXd Jdot, contracted = MatrixXd::Zero(6, indices.size());
+        hubo.jacobianDot(Jdot, indices, qdot, tools[t]->respectToRobot().translation(), reference);
+        for(size_t j=0; j<indices.size(); j++)
+            contracted += H[j]*qdot[j];
+        check(Jdot.isApprox(contracted, 1e-10), "Hessian contracted with qdot gives jacobianDot()");
+    }
+
+    return failures == 0;
+}
+
+
+bool centerOfMassJacobianTest()
+{
+    cout << "------------------------------------" << endl;
+    cout << "| Testing Center of Mass Jacobians |" << endl;
+    cout << "------------------------------------" << endl;
+
+    Hubo hubo;
+    hubo.imposeLimits = false;
+    for(size_t i=0; i<hubo.nJoints(); i++)
+        hubo.joint(i).link.setMass(0.5 + (double)rand()/RAND_MAX,
+                                   TRANSLATION(0.02, -0.03, 0.1*rand()/RAND_MAX));
+    for(size_t i=0; i<hubo.nLinkages(); i++)
+        hubo.linkage(i).tool().massProperties.setMass(0.3, TRANSLATION(0.0, 0.01, 0.05));
+    hubo.rootLink.setMass(2.0, TRANSLATION(0.0, 0.0, 0.1));
+    hubo.respectToWorld(TRANSFORM(AngleAxisd(0.4, AXIS(0.0, 1.0, 1.0).normalized())));
+
+    VectorXd q;
+    randomValues(hubo, q);
+    hubo.values(q);
+
+    MatrixXd J;
+    hubo.centerOfMassJacobian(J, &hubo);
+
+    double h = 1e-6;
+    MatrixXd numeric(3, hubo.nJoints());
+    for(size_t j=0; j<hubo.nJoints(); j++)
+    {
+        VectorXd qh = q;
+        qh[j] += h;
+        hubo.values(qh);
+        TRANSLATION plus = hubo.centerOfMass(ROBOT);
+        qh[j] -= 2*h;
+        hubo.values(qh);
+        numeric.col(j) = (plus - hubo.centerOfMass(ROBOT))/(2*h);
+    }
+    hubo.values(q);
+    check(J.rows() == 3 && J.cols() == (int)hubo.nJoints() && (J - numeric).norm() < 1e-6,
+          "Whole robot Jacobian matches finite differences");
+
+    vector<size_t> legs;
+    for(size_t i=0; i<hubo.linkage("LEFT_LEG").nJoints(); i++)
+        legs.push_back(hubo.linkage("LEFT_LEG").joint(i).id());
+    for(size_t i=0; i<hubo.linkage("RIGHT_LEG").nJoints(); i++)
+        legs.push_back(hubo.linkage("RIGHT_LEG").joint(i).id());
+
+    MatrixXd Jlegs;
+    hubo.centerOfMassJacobian(Jlegs, legs, &hubo);
+    bool ok = Jlegs.cols() == (int)legs.size();
+    for(size_t i=0; i<legs.size() && ok; i++)
+        ok &= Jlegs.col(i).isApprox(J.col(legs[i]), 1e-12);
+    check(ok, "Joint subset picks the matching columns");
+
+    MatrixXd Jworld;
+    hubo.centerOfMassJacobian(Jworld, legs, &hubo.linkage("TORSO"));
+    Matrix3d r = hubo.linkage("TORSO").respectToWorld().rotation().transpose()*hubo.respectToWorld().rotation();
+    check(Jworld.isApprox(r*Jlegs, 1e-12), "Jacobian in another frame");
+
+    return failures == 0;
+}
+
+
+//------------------------------------------------------------------------------
+// Helper Functions
+//------------------------------------------------------------------------------
+TRANSFORM referenceLocalPose(const Joint& joint)
+{
+    TRANSFORM pose = joint.respectToFixed();
+    if(joint.getJointType() == REVOLUTE)
+        pose = pose * AngleAxisd(joint.value(), joint.getJointAxis());
+    else if(joint.getJointType() == PRISMATIC)
+        pose = pose * Translation3d(joint.value()*joint.getJointAxis());
+    return pose;
+}
+
+TRANSFORM referenceLinkagePose(Robot& robot, size_t linkageIndex)
+{
+    Linkage& linkage = robot.linkage(linkageIndex);
+    if(linkage.getParentLinkageName() == "")
+        return linkage.respectToFixed();
+
+    return referenceToolPose(robot, linkage.getParentLinkageID()) * linkage.respectToFixed();
+}
+
+TRANSFORM referenceToolPose(Robot& robot, size_t linkageIndex)
+{
+    Linkage& linkage = robot.linkage(linkageIndex);
+    TRANSFORM pose = referenceLinkagePose(robot, linkageIndex);
+    for(size_t i=0; i<linkage.nJoints(); i++)
+        pose = pose * referenceLocalPose(linkage.const_joint(i));
+    return pose * linkage.const_tool().respectToFixed();
+}
+
+TRANSFORM referenceJointPose(Robot& robot, size_t jointIndex)
+{
+    Joint& joint = robot.joint(jointIndex);
+    Linkage& linkage = joint.linkage();
+    TRANSFORM pose = referenceLinkagePose(robot, linkage.id());
+    for(size_t i=0; i<=joint.localID(); i++)
+        pose = pose * referenceLocalPose(linkage.const_joint(i));
+    return pose;
+}
+
+Matrix3d robotInertia(Robot& robot, TRANSLATION& com)
+{
+    // Every link with its pose with respect to the robot
+    vector<const Link*> links;
+    vector<TRANSFORM> poses;
+    links.push_back(&robot.rootLink);
+    poses.push_back(TRANSFORM::Identity());
+    for(size_t i=0; i<robot.nJoints(); i++)
+    {
+        links.push_back(&robot.joint(i).link);
+        poses.push_back(robot.joint(i).respectToRobot());
+    }
+    for(size_t i=0; i<robot.nLinkages(); i++)
+    {
+        links.push_back(&robot.linkage(i).tool().massProperties);
+        poses.push_back(robot.linkage(i).tool().respectToRobot());
+    }
+
+    double mass = 0;
+    com.setZero();
+    for(size_t i=0; i<links.size(); i++)
+    {
+        mass += links[i]->mass();
+        com += links[i]->mass()*(poses[i]*links[i]->const_com());
+    }
+    com /= mass;
+
+    Matrix3d I = Matrix3d::Zero();
+    for(size_t i=0; i<links.size(); i++)
+    {
+        TRANSLATION d = poses[i]*links[i]->const_com() - com;
+        I += poses[i].rotation()*links[i]->const_tensor()*poses[i].rotation().transpose()
+             + links[i]->mass()*(d.dot(d)*Matrix3d::Identity() - d*d.transpose());
+    }
+    return I;
+}
+
+bool isApprox(const TRANSFORM& a, const TRANSFORM& b, double tol)
+{
+    return (a.matrix() - b.matrix()).norm() < tol;
+}
+
+void randomValues(Robot& robot, VectorXd& q)
+{
+    q.resize(robot.nJoints());
+    for(int i=0; i<q.size(); i++)
+        q[i] = ((double)rand()/RAND_MAX*2-1)*M_PI;
+}
+
+bool check(bool condition, string description)
+{
+    cout << (condition ? "  PASS: " : "  FAIL: ") << description << endl;
+    if(!condition)
+        failures++;
+    return condition;
+}